@@ -20,8 +20,16 @@
 #include <linux/slab.h>
 #include <linux/kmod.h>
 #include <linux/atomic.h>
+#include <linux/string.h>
+#include <linux/debugfs.h>
 
 #include <wrong8007.h>
+#include <latency.h>
+#include <stats.h>
+#include <events.h>
+
+#define CREATE_TRACE_POINTS
+#include <wrong8007_trace.h>
 
 #define REGISTER_TRIGGER(t) &t
 #define EXEC_MAX_LEN 4096
@@ -33,12 +41,30 @@ MODULE_DESCRIPTION("wrong8007 is an equivalent of a burner phone");
 static char *exec;
 module_param(exec, charp, 0000);
 
+static bool exec_direct;
+module_param(exec_direct, bool, 0000);
+MODULE_PARM_DESC(exec_direct, "run exec as an argv vector without /bin/sh (first word must be an absolute path)");
+
 // Internal storage of module params
 static char *exec_buf;
+static char **exec_argv;
 
-// Deferred work to run userspace helper
+/*
+ * Deferred work to run userspace helper, on a dedicated high-priority
+ * queue so it never waits behind unrelated work on the system queues.
+ */
+static struct workqueue_struct *exec_wq;
 static struct work_struct exec_work;
 
+// Helper staged at load so that activation does not allocate
+static struct subprocess_info *exec_info;
+
+// Trigger that armed execution, written once by the winning activation
+static enum wb_source exec_source;
+
+// Root of the module's debugfs entries
+static struct dentry *wb_debugfs_dir;
+
 // Execution policy state
 static atomic_t exec_armed = ATOMIC_INIT(1);
 
@@ -46,6 +72,7 @@ static atomic_t exec_armed = ATOMIC_INIT(1);
 extern struct wrong8007_trigger keyboard_trigger;
 extern struct wrong8007_trigger usb_trigger;
 extern struct wrong8007_trigger network_trigger;
+extern struct wrong8007_trigger input_trigger;
 
 /*
  * Trigger interface contract:
@@ -65,6 +92,7 @@ static struct wrong8007_trigger *triggers[] = {
     REGISTER_TRIGGER(keyboard_trigger),
     REGISTER_TRIGGER(usb_trigger),
     REGISTER_TRIGGER(network_trigger),
+    REGISTER_TRIGGER(input_trigger),
 };
 
 // Minimal environment for shell execution
@@ -75,22 +103,170 @@ static char *env[] = {
 };
 
 /*
- * Deferred work handler to execute usermode command
+ * Copy a parameter value, dropping the newline a sysfs write carries.
  */
-static void do_exec_work(struct work_struct *w)
+static char *wb_param_dup(const char *val)
+{
+    size_t len = strlen(val);
+
+    if (len && val[len - 1] == '\n')
+        len--;
+
+    return kstrndup(val, len, GFP_KERNEL);
+}
+
+/*
+ * Reloadable string parameter.
+ *
+ * A write is first handed to the owning trigger, which compiles and
+ * publishes the new configuration if it is running; the string is only
+ * replaced once that succeeded, so a rejected write changes nothing.
+ * Writes are serialized by the module's parameter lock.
+ */
+static int wb_param_set_reload(const char *val, const struct kernel_param *kp)
 {
+    struct wb_param_reload *r = kp->arg;
+    char *s = wb_param_dup(val);
     int ret;
-    struct subprocess_info *info;
-    const char *argv[4] = { "/bin/sh", "-c", exec_buf, NULL };
 
-    info = call_usermodehelper_setup(argv[0], (char **)argv, env, GFP_KERNEL, NULL, NULL, NULL);
-    if (!info) {
+    if (!s)
+        return -ENOMEM;
+
+    ret = r->apply(s);
+    if (ret) {
+        kfree(s);
+        return ret;
+    }
+
+    kfree(*r->str);
+    *r->str = s;
+    wb_event_tag(WB_EV_CONFIG, WB_EV_NO_SOURCE, 0, 0,
+                 kp->name, strlen(kp->name));
+    return 0;
+}
+
+static int wb_param_get_reload(char *buffer, const struct kernel_param *kp)
+{
+    const struct wb_param_reload *r = kp->arg;
+
+    return scnprintf(buffer, PAGE_SIZE, "%s\n", *r->str ? *r->str : "");
+}
+
+static void wb_param_free_reload(void *arg)
+{
+    const struct wb_param_reload *r = arg;
+
+    kfree(*r->str);
+    *r->str = NULL;
+}
+
+const struct kernel_param_ops wb_param_ops_reload = {
+    .set = wb_param_set_reload,
+    .get = wb_param_get_reload,
+    .free = wb_param_free_reload,
+};
+
+// Name of a trigger source, for logs and debugfs
+const char *wb_source_name(enum wb_source src)
+{
+    static const char *const names[WB_SRC_COUNT] = {
+        [WB_SRC_KEYBOARD]  = "keyboard",
+        [WB_SRC_USB]       = "usb",
+        [WB_SRC_NETWORK]   = "network",
+        [WB_SRC_HEARTBEAT] = "heartbeat",
+        [WB_SRC_INPUT]     = "input",
+    };
+
+    return src < WB_SRC_COUNT ? names[src] : "unknown";
+}
+
+/*
+ * Runs in the helper process right before it execs the action.
+ */
+static int exec_helper_init(struct subprocess_info *info, struct cred *new)
+{
+    trace_wrong8007_helper_exec(exec_source);
+    wb_latency_mark(WB_STAGE_EXEC, exec_source);
+    return 0;
+}
+
+/*
+ * Prepare the helper invocation ahead of time, either through the shell
+ * or, with exec_direct, as the split argument vector itself.
+ */
+static int exec_stage(void)
+{
+    static char *sh_argv[4] = { "/bin/sh", "-c", NULL, NULL };
+    char **argv = sh_argv;
+    int argc;
+
+    if (exec_direct) {
+        exec_argv = argv_split(GFP_KERNEL, exec_buf, &argc);
+        if (!exec_argv)
+            return -ENOMEM;
+
+        if (!argc || exec_argv[0][0] != '/') {
+            wb_err("exec_direct requires an absolute path\n");
+            argv_free(exec_argv);
+            exec_argv = NULL;
+            return -EINVAL;
+        }
+        argv = exec_argv;
+    } else {
+        sh_argv[2] = exec_buf;
+    }
+
+    exec_info = call_usermodehelper_setup(argv[0], argv, env, GFP_KERNEL,
+                                          exec_helper_init, NULL, NULL);
+    if (!exec_info) {
         wb_err("helper setup failed\n");
-        return;
+        if (exec_argv)
+            argv_free(exec_argv);
+        exec_argv = NULL;
+        return -ENOMEM;
     }
 
+    return 0;
+}
+
+/*
+ * Release a helper that was never run.
+ *
+ * There is no exported way to free a subprocess_info; a NULL path makes
+ * call_usermodehelper_exec() free it without starting anything.
+ */
+static void exec_discard(void)
+{
+    if (exec_info) {
+        exec_info->path = NULL;
+        call_usermodehelper_exec(exec_info, UMH_NO_WAIT);
+        exec_info = NULL;
+    }
+
+    if (exec_argv)
+        argv_free(exec_argv);
+    exec_argv = NULL;
+}
+
+/*
+ * Deferred work handler to execute usermode command
+ */
+static void do_exec_work(struct work_struct *w)
+{
+    struct subprocess_info *info = exec_info;
+    int ret;
+
+    trace_wrong8007_work_start(exec_source);
+    wb_latency_mark(WB_STAGE_WORK, exec_source);
+
+    // The helper is consumed by call_usermodehelper_exec()
+    exec_info = NULL;
+
     /* Wait for completion to ensure one-shot semantics */
     ret = call_usermodehelper_exec(info, UMH_WAIT_PROC);
+
+    trace_wrong8007_helper_exit(exec_source, ret);
+    wb_latency_mark(WB_STAGE_EXIT, exec_source);
     wb_dbg("exec returned %d\n", ret);
 }
 
@@ -99,13 +275,22 @@ static void do_exec_work(struct work_struct *w)
  * backends when their activation condition is satisfied.
  *
  * Only the first caller while execution is armed will schedule
- * the deferred work; all subsequent calls are ignored.
+ * the deferred work and emit the match and activate events; all
+ * subsequent calls are ignored, so a trigger that keeps matching
+ * after firing does not flood the trace buffer or the event stream.
  *
  */
-void wrong8007_activate(void)
+void wrong8007_activate(enum wb_source src, ktime_t detected)
 {
     if (atomic_cmpxchg(&exec_armed, 1, 0) == 1) {
-        schedule_work(&exec_work);
+        trace_wrong8007_match(src);
+        wb_event(WB_EV_MATCH, src, 0, 0);
+        exec_source = src;
+        wb_latency_match(src, detected);
+        trace_wrong8007_activate(src);
+        wb_event(WB_EV_ACTIVATE, src, 0, 0);
+        wb_latency_mark(WB_STAGE_ACTIVATE, src);
+        queue_work(exec_wq, &exec_work);
     }
 }
 
@@ -130,6 +315,24 @@ static int __init wrong8007_init(void)
         return -ENOMEM;
     }
 
+    exec_wq = alloc_workqueue("wrong8007", WQ_HIGHPRI | WQ_UNBOUND | WQ_MEM_RECLAIM, 1);
+    if (!exec_wq) {
+        err = -ENOMEM;
+        goto fail_wq;
+    }
+
+    err = exec_stage();
+    if (err)
+        goto fail_stage;
+
+    wb_debugfs_dir = debugfs_create_dir("wrong8007", NULL);
+    wb_latency_debugfs(wb_debugfs_dir);
+    wb_counters_debugfs(wb_debugfs_dir);
+
+    err = wb_events_init();
+    if (err)
+        goto fail_events;
+
     // Explicitly re-arm execution on module load; redundant with static initialization but intentional
     atomic_set(&exec_armed, 1);
 
@@ -150,6 +353,13 @@ fail:
     while (--i >= 0)
         triggers[i]->exit();
 
+    wb_events_exit();
+fail_events:
+    exec_discard();
+    debugfs_remove_recursive(wb_debugfs_dir);
+fail_stage:
+    destroy_workqueue(exec_wq);
+fail_wq:
     kfree(exec_buf);
     return err;
 }
@@ -163,7 +373,11 @@ static void __exit wrong8007_exit(void)
     for (i = 0; i < ARRAY_SIZE(triggers); i++)
         triggers[i]->exit();
 
-    flush_work(&exec_work);
+    // Waits for a running helper before the staged one can be dropped
+    destroy_workqueue(exec_wq);
+    exec_discard();
+    wb_events_exit();
+    debugfs_remove_recursive(wb_debugfs_dir);
     kfree(exec_buf);
     wb_info("unloaded\n");
 }
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: Aho-Corasick multi-pattern automaton
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#ifndef WRONG8007_AC_H
+#define WRONG8007_AC_H
+
+#include <linux/types.h>
+
+/* Maximum number of patterns; each one owns a bit of the output mask */
+#define WB_AC_MAX_PATTERNS 32
+
+/* Set on a transition whose target state completes at least one pattern */
+#define WB_AC_MATCH 0x8000
+
+/*
+ * Compiled automaton.
+ *
+ * Bytes are first folded into alphabet classes so that the transition
+ * table only has a column for each byte that occurs in some pattern,
+ * plus one shared column for everything else. The table is a single
+ * flat array indexed by state * nclasses + class.
+ */
+struct wb_ac {
+    u16 nstates;
+    u16 nclasses;
+    u8 class_of[256];
+    u16 *next;
+    u32 *out;
+    u16 *depth;                 /* length of the prefix each state stands for */
+};
+
+int wb_ac_build(struct wb_ac *ac, const u8 *const *patterns,
+                const size_t *lens, unsigned int count);
+void wb_ac_free(struct wb_ac *ac);
+u32 wb_ac_feed(const struct wb_ac *ac, u16 *state,
+               const u8 *buf, size_t len, u32 want);
+
+/*
+ * Advance the automaton by a single byte.
+ *
+ * The returned value carries WB_AC_MATCH when a pattern ends on this
+ * byte; callers must mask it off before stepping again.
+ */
+static inline u16 wb_ac_step(const struct wb_ac *ac, u16 state, u8 c)
+{
+    return ac->next[(size_t)state * ac->nclasses + ac->class_of[c]];
+}
+
+#endif
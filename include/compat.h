@@ -1,13 +1,25 @@
 #include <linux/version.h>
-#include <linux/timer.h>
+#include <linux/hrtimer.h>
 #include <linux/inet.h>
+#include <net/ipv6.h>
 
-static inline void wb_timer_delete_sync(struct timer_list *timer)
+/*
+ * Soft hrtimers run their callback in softirq context, like timer_list.
+ * Older kernels only have hard ones, so callbacks must also be safe there.
+ */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 16, 0)
+#define HRTIMER_MODE_ABS_SOFT HRTIMER_MODE_ABS
+#endif
+
+static inline void wb_hrtimer_setup(struct hrtimer *timer,
+                                    enum hrtimer_restart (*fn)(struct hrtimer *),
+                                    clockid_t clock, enum hrtimer_mode mode)
 {
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 15, 0)
-    timer_delete_sync(timer);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    hrtimer_setup(timer, fn, clock, mode);
 #else
-    del_timer_sync(timer);
+    hrtimer_init(timer, clock, mode);
+    timer->function = fn;
 #endif
 }
 
@@ -26,3 +38,19 @@ static inline bool wb_parse_ipv4(const char *ip, __be32 *out)
     return *out != 0;
 #endif
 }
+
+/*
+ * Parse an IPv4 or IPv6 address. IPv4 addresses are returned in their
+ * IPv4-mapped IPv6 form so that both families compare the same way.
+ */
+static inline bool wb_parse_inet(const char *ip, struct in6_addr *out)
+{
+    __be32 v4;
+
+    if (wb_parse_ipv4(ip, &v4)) {
+        ipv6_addr_set_v4mapped(v4, out);
+        return true;
+    }
+
+    return ip && in6_pton(ip, -1, (u8 *)out, '\0', NULL);
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: binary event stream on /dev/wrong8007
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#ifndef WRONG8007_EVENTS_H
+#define WRONG8007_EVENTS_H
+
+#include <linux/types.h>
+#include <linux/jump_label.h>
+
+#include <wrong8007.h>
+
+/*
+ * Event types. The record layout and these values are read by
+ * tools/wrong8007ctl.c; only ever append to them.
+ */
+enum wb_event_type {
+    WB_EV_LOST,         /* arg[0] events dropped on this CPU */
+    WB_EV_MATCH,        /* a trigger condition held and claimed execution */
+    WB_EV_ACTIVATE,     /* the action was scheduled */
+    WB_EV_PARTIAL,      /* arg[0] bytes of a phrase typed, then abandoned */
+    WB_EV_TIMING,       /* phrase arg[0] typed outside its window or cadence */
+    WB_EV_HB_GAP,       /* arg[0] ms since the host's last heartbeat, arg[1] timeout ms */
+    WB_EV_CONFIG,       /* parameter named in tag rewritten */
+    WB_EV_PACKET,       /* arg[0] bytes, arg[1] L4 protocol, tag source address */
+    WB_EV_TYPES
+};
+
+/* Source of events that do not come from a trigger */
+#define WB_EV_NO_SOURCE 0xff
+
+#define WB_EV_TAG_LEN 16
+
+/*
+ * One fixed-size record. Records are read in per-CPU order; merge
+ * streams from different CPUs by ts_ns (CLOCK_MONOTONIC).
+ */
+struct wb_event {
+    __u64 ts_ns;
+    __u16 type;
+    __u8 source;                /* enum wb_source or WB_EV_NO_SOURCE */
+    __u8 pad;
+    __u32 cpu;
+    __u64 arg[2];
+    __u8 tag[WB_EV_TAG_LEN];
+};
+
+/* Enabled while /dev/wrong8007 is open; events are free otherwise */
+DECLARE_STATIC_KEY_FALSE(wb_events_key);
+
+/* jiffies when the current reader opened the device */
+extern unsigned long wb_events_epoch;
+
+static inline bool wb_events_on(void)
+{
+    return static_branch_unlikely(&wb_events_key);
+}
+
+void __wb_event(u16 type, u8 source, u64 a0, u64 a1,
+                const void *tag, size_t tag_len);
+
+static inline void wb_event(u16 type, u8 source, u64 a0, u64 a1)
+{
+    if (wb_events_on())
+        __wb_event(type, source, a0, a1, NULL, 0);
+}
+
+static inline void wb_event_tag(u16 type, u8 source, u64 a0, u64 a1,
+                                const void *tag, size_t tag_len)
+{
+    if (wb_events_on())
+        __wb_event(type, source, a0, a1, tag, tag_len);
+}
+
+int wb_events_init(void);
+void wb_events_exit(void);
+
+#endif
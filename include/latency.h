@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: activation latency accounting
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#ifndef WRONG8007_LATENCY_H
+#define WRONG8007_LATENCY_H
+
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+
+#include <wrong8007.h>
+
+/* Stages of an activation, in the order they happen */
+enum wb_stage {
+    WB_STAGE_MATCH,         /* trigger condition held */
+    WB_STAGE_ACTIVATE,      /* execution armed and work queued */
+    WB_STAGE_WORK,          /* work item started */
+    WB_STAGE_EXEC,          /* helper process about to exec */
+    WB_STAGE_EXIT,          /* helper returned */
+    WB_STAGE_COUNT
+};
+
+/* log2 nanosecond buckets; the last one collects everything above ~9 min */
+#define WB_LAT_BUCKETS 40
+
+void wb_latency_match(enum wb_source src, ktime_t at);
+void wb_latency_mark(enum wb_stage stage, enum wb_source src);
+void wb_latency_debugfs(struct dentry *dir);
+
+#endif
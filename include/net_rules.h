@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: compiled network match rules
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#ifndef WRONG8007_NET_RULES_H
+#define WRONG8007_NET_RULES_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/jhash.h>
+#include <linux/if_ether.h>
+#include <linux/in6.h>
+
+/* Upper bound on the number of rules accepted in one rule set */
+#define WB_NET_MAX_RULES 65536
+
+/* Rule condition flags */
+#define WB_RULE_MAC     BIT(0)
+#define WB_RULE_PORT    BIT(1)
+#define WB_RULE_L4      BIT(2)  /* needs the transport header */
+
+/*
+ * A single network rule.
+ *
+ * Every present condition must hold for the rule to match. The source
+ * address is stored masked to its prefix length; IPv4 prefixes are kept
+ * IPv4-mapped, so a /24 becomes a /120. A prefix of 0 matches any source.
+ */
+struct wb_net_rule {
+    struct hlist_node node;
+    struct in6_addr addr;
+    u8 mac[ETH_ALEN];           /* kept 2-byte aligned for ether_addr_equal */
+    u8 prefix;
+    u8 proto;                   /* 0 = any */
+    u8 flags;
+    u16 port_lo;
+    u16 port_hi;
+    u32 payloads;               /* 0 = no payload condition */
+};
+
+/*
+ * Compiled rule set, published under RCU and never modified afterwards.
+ *
+ * Rules are hashed on (masked source address, prefix length). A packet
+ * is looked up once per distinct prefix length in use, so the cost does
+ * not depend on the number of rules. The port bitmap records every port
+ * referenced by a rule and rejects packets before any range check.
+ */
+struct wb_net_ruleset {
+    unsigned int count;
+    unsigned int hash_mask;
+    struct hlist_head *buckets;
+    struct wb_net_rule *rules;
+    unsigned long *ports;
+    u8 prefixes[129];           /* distinct prefix lengths, longest first */
+    unsigned int nprefixes;
+    u8 need;                    /* union of all rule flags */
+};
+
+bool wb_parse_mac(const char *s, u8 *out);
+int wb_net_rules_parse(const char *spec, struct wb_net_rule **rules,
+                       unsigned int *count);
+struct wb_net_ruleset *wb_net_ruleset_build(const struct wb_net_rule *rules,
+                                            unsigned int count);
+void wb_net_ruleset_free(struct wb_net_ruleset *rs);
+
+static inline struct hlist_head *
+wb_net_bucket(const struct wb_net_ruleset *rs, const struct in6_addr *key,
+              u8 prefix)
+{
+    return &rs->buckets[jhash2((const u32 *)key->s6_addr32, 4, prefix) &
+                        rs->hash_mask];
+}
+
+#endif
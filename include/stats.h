@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: per-CPU event counters
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#ifndef WRONG8007_STATS_H
+#define WRONG8007_STATS_H
+
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+
+enum wb_counter {
+    WB_CNT_NET_PACKETS,        /* packets seen by the hook */
+    WB_CNT_NET_L3_FAIL,        /* IPv4/IPv6 header could not be pulled */
+    WB_CNT_NET_L4_FAIL,        /* transport header could not be pulled */
+    WB_CNT_NET_HEARTBEAT,      /* heartbeat packets */
+    WB_CNT_NET_HB_BAD,         /* heartbeats with a bad format or tag */
+    WB_CNT_NET_HB_REPLAY,      /* authenticated heartbeats replayed */
+    WB_CNT_NET_RULE_HIT,       /* rules whose conditions held */
+    WB_CNT_NET_PAYLOAD_SCANS,  /* payload searches */
+    WB_CNT_NET_PAYLOAD_BYTES,  /* payload bytes searched */
+    WB_CNT_NET_PAYLOAD_HIT,    /* payload searches that matched */
+    WB_CNT_KBD_EVENTS,         /* keyboard notifications */
+    WB_CNT_KBD_CHARS,          /* printable characters matched against */
+    WB_CNT_KBD_HIT,            /* phrase matches */
+    WB_CNT_USB_EVENTS,         /* USB device add/remove notifications */
+    WB_CNT_USB_HIT,            /* USB events that fired */
+    WB_CNT_USB_COALESCED,      /* repeated USB events skipped in a batch */
+    WB_CNT_USB_RING_FULL,      /* USB events matched in the notifier */
+    WB_CNT_INPUT_EVENTS,       /* raw key presses and releases */
+    WB_CNT_INPUT_HIT,          /* key sequence or chord matches */
+    WB_CNT_COUNT
+};
+
+/*
+ * Counters are kept per CPU and only summed when read, so updating one
+ * is a single CPU-local add with no shared cache line or atomic.
+ */
+struct wb_counters {
+    u64 v[WB_CNT_COUNT];
+};
+
+DECLARE_PER_CPU(struct wb_counters, wb_counters_pcpu);
+
+static inline void wb_count_add(enum wb_counter s, u64 n)
+{
+    this_cpu_add(wb_counters_pcpu.v[s], n);
+}
+
+static inline void wb_count_inc(enum wb_counter s)
+{
+    this_cpu_inc(wb_counters_pcpu.v[s]);
+}
+
+void wb_counters_debugfs(struct dentry *dir);
+
+#endif
@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: compiled USB device rules
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#ifndef WRONG8007_USB_RULES_H
+#define WRONG8007_USB_RULES_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/bitmap.h>
+
+/* Upper bound on the number of rules accepted in one rule set */
+#define WB_USB_MAX_RULES 65536
+
+/* Which identifier a rule is keyed on; each kind has its own hash table */
+enum wb_usb_kind {
+    WB_USB_DEVICE,      /* VID:PID */
+    WB_USB_VENDOR,      /* VID:* */
+    WB_USB_CLASS,       /* class=CC on the device or an interface, any vendor */
+    WB_USB_KINDS,
+    WB_USB_PATH = WB_USB_KINDS, /* path=BUS-PORT[.PORT...], kept in the port trie */
+};
+
+/* Events a rule fires on */
+#define WB_USB_INSERT   BIT(0)
+#define WB_USB_EJECT    BIT(1)
+
+/* Bus numbers and port paths, as in /sys/bus/usb/devices/BUS-P.P.P */
+#define WB_USB_MAX_BUS      64      /* USB_MAXBUS */
+#define WB_USB_MAX_DEPTH    7       /* tiers below the root hub */
+#define WB_USB_MAX_PORT     31      /* USB_MAXCHILDREN */
+
+/* Class codes are one byte; the device class and every interface class share a map */
+#define WB_USB_CLASSES  256
+
+/*
+ * A single USB rule.
+ *
+ * key holds vid << 16 | pid, vid or the class code depending on the
+ * table the rule lives in. String conditions are kept as keyed hashes
+ * (see wb_usb_str_hash()) so that a device's strings can be compared
+ * after the device itself is gone.
+ */
+struct wb_usb_rule {
+    struct hlist_node node;
+    u32 key;
+    u8 events;
+    bool locked;                /* only while the host is locked */
+    s16 class;                  /* -1 = any */
+    u64 serial;                 /* 0 = any */
+    u64 mfr;                    /* 0 = any */
+    bool pinned;                /* path rule naming the device that belongs there */
+};
+
+/*
+ * Node of a per-bus port trie. A device's port path leads from the
+ * bus root through one child per hub port; rules pinned to that path
+ * hang off the node it ends at.
+ */
+struct wb_usb_port_node {
+    struct wb_usb_port_node *child[WB_USB_MAX_PORT];
+    struct hlist_head rules;
+};
+
+/*
+ * Compiled rule set, published under RCU and never modified afterwards.
+ *
+ * A device is looked up once per kind in use, so matching costs a hash
+ * probe per table regardless of the number of rules. The class map holds
+ * every class referenced by a class-keyed rule; a device whose classes
+ * miss it entirely is rejected without touching the class table.
+ */
+struct wb_usb_ruleset {
+    unsigned int count;
+    unsigned int hash_bits;
+    u8 kinds;                   /* BIT(kind) for every non-empty table */
+    struct hlist_head *buckets; /* WB_USB_KINDS tables of 1 << hash_bits */
+    struct wb_usb_rule *rules;
+    bool need_classes;          /* some rule tests a class */
+    bool need_strings;          /* some rule tests serial or manufacturer */
+    bool need_paths;            /* some rule is a port path rule */
+    struct wb_usb_port_node *buses[WB_USB_MAX_BUS + 1];
+    DECLARE_BITMAP(classes, WB_USB_CLASSES);
+};
+
+/*
+ * Features of a device, as seen by the matcher. Built once per event
+ * from the descriptors the USB core has already read; self-contained,
+ * so it can be queued and matched later.
+ */
+struct wb_usb_id {
+    u16 vid;
+    u16 pid;
+    bool locked;                /* host was locked when the event arrived */
+    u64 serial;                 /* wb_usb_str_hash(), 0 = none */
+    u64 mfr;
+    u8 bus;                     /* 0 = unknown */
+    u8 depth;
+    u8 ports[WB_USB_MAX_DEPTH];
+    DECLARE_BITMAP(classes, WB_USB_CLASSES);
+};
+
+void wb_usb_rules_init(void);
+u64 wb_usb_str_hash(const char *s);
+struct wb_usb_ruleset *wb_usb_rules_build(const char *spec);
+void wb_usb_ruleset_free(struct wb_usb_ruleset *rs);
+bool wb_usb_rules_match(const struct wb_usb_ruleset *rs,
+                        const struct wb_usb_id *id, u8 event);
+bool wb_usb_paths_match(const struct wb_usb_ruleset *rs,
+                        const struct wb_usb_id *id, u8 event);
+int wb_usb_parse_ports(const char *s, u8 *ports, u8 *depth);
+
+#endif
@@ -11,6 +11,7 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/workqueue.h>
+#include <linux/ktime.h>
 
 #define WB_TAG "wrong8007: "
 
@@ -30,7 +31,35 @@ struct wrong8007_trigger {
     void (*exit)(void);
 };
 
-/* Safe to call from atomic / notifier context */
-void wrong8007_activate(void);
+/* Trigger that reported a match, recorded in traces and latency stats */
+enum wb_source {
+    WB_SRC_KEYBOARD,
+    WB_SRC_USB,
+    WB_SRC_NETWORK,
+    WB_SRC_HEARTBEAT,
+    WB_SRC_INPUT,
+    WB_SRC_COUNT
+};
+
+/*
+ * Safe to call from atomic / notifier context. detected is when the
+ * trigger saw the condition (ktime_get()), for latency accounting.
+ */
+void wrong8007_activate(enum wb_source src, ktime_t detected);
+const char *wb_source_name(enum wb_source src);
+
+/*
+ * String parameter that can be rewritten at runtime through sysfs.
+ *
+ * apply() receives the new value and returns 0 to accept it. It runs
+ * under the module parameter lock, which triggers also take while they
+ * read the string at init and tear down at exit.
+ */
+struct wb_param_reload {
+    char **str;
+    int (*apply)(const char *val);
+};
+
+extern const struct kernel_param_ops wb_param_ops_reload;
 
 #endif
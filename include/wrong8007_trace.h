@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: activation tracepoints
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM wrong8007
+
+#if !defined(WRONG8007_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define WRONG8007_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#include <wrong8007.h>
+
+TRACE_DEFINE_ENUM(WB_SRC_KEYBOARD);
+TRACE_DEFINE_ENUM(WB_SRC_USB);
+TRACE_DEFINE_ENUM(WB_SRC_NETWORK);
+TRACE_DEFINE_ENUM(WB_SRC_HEARTBEAT);
+TRACE_DEFINE_ENUM(WB_SRC_INPUT);
+
+#define wb_show_source(src)                         \
+    __print_symbolic(src,                           \
+        { WB_SRC_KEYBOARD,  "keyboard" },           \
+        { WB_SRC_USB,       "usb" },                \
+        { WB_SRC_NETWORK,   "network" },            \
+        { WB_SRC_HEARTBEAT, "heartbeat" },          \
+        { WB_SRC_INPUT,     "input" })
+
+/*
+ * One event per stage between a trigger condition holding and the
+ * action finishing: match, activate, work_start, helper_exec and
+ * helper_exit. Only the report that claims execution emits them; later
+ * reports are dropped before tracing.
+ */
+DECLARE_EVENT_CLASS(wrong8007_stage,
+
+    TP_PROTO(enum wb_source src),
+
+    TP_ARGS(src),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, src)
+    ),
+
+    TP_fast_assign(
+        __entry->src = src;
+    ),
+
+    TP_printk("source=%s", wb_show_source(__entry->src))
+);
+
+DEFINE_EVENT(wrong8007_stage, wrong8007_match,
+    TP_PROTO(enum wb_source src),
+    TP_ARGS(src)
+);
+
+DEFINE_EVENT(wrong8007_stage, wrong8007_activate,
+    TP_PROTO(enum wb_source src),
+    TP_ARGS(src)
+);
+
+DEFINE_EVENT(wrong8007_stage, wrong8007_work_start,
+    TP_PROTO(enum wb_source src),
+    TP_ARGS(src)
+);
+
+DEFINE_EVENT(wrong8007_stage, wrong8007_helper_exec,
+    TP_PROTO(enum wb_source src),
+    TP_ARGS(src)
+);
+
+TRACE_EVENT(wrong8007_helper_exit,
+
+    TP_PROTO(enum wb_source src, int ret),
+
+    TP_ARGS(src, ret),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, src)
+        __field(int, ret)
+    ),
+
+    TP_fast_assign(
+        __entry->src = src;
+        __entry->ret = ret;
+    ),
+
+    TP_printk("source=%s ret=%d", wb_show_source(__entry->src), __entry->ret)
+);
+
+#endif
+
+/* Resolved against the -I$(src)/include search path set in Kbuild */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE wrong8007_trace
+
+#include <trace/define_trace.h>
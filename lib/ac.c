@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: Aho-Corasick multi-pattern automaton
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/string.h>
+
+#include <wrong8007.h>
+#include <ac.h>
+
+/*
+ * Compile a set of patterns into a deterministic automaton.
+ *
+ * Missing transitions are resolved through the failure links at build
+ * time, so matching never backtracks and costs one table lookup per
+ * input byte regardless of the number of patterns.
+ */
+int wb_ac_build(struct wb_ac *ac, const u8 *const *patterns,
+                const size_t *lens, unsigned int count)
+{
+    u16 *fail = NULL, *queue = NULL;
+    size_t total = 1;
+    unsigned int head = 0, tail = 0;
+    unsigned int i, c;
+    size_t j;
+
+    memset(ac, 0, sizeof(*ac));
+
+    if (!count || count > WB_AC_MAX_PATTERNS)
+        return -EINVAL;
+
+    /*
+     * Fold the bytes used by the patterns into alphabet classes. Class 0
+     * is shared by every other byte; if the patterns use all 256 byte
+     * values, the last one simply takes class 0 for itself.
+     */
+    ac->nclasses = 1;
+    for (i = 0; i < count; i++) {
+        if (!lens[i])
+            return -EINVAL;
+
+        total += lens[i];
+        for (j = 0; j < lens[i]; j++) {
+            u8 b = patterns[i][j];
+
+            if (!ac->class_of[b] && ac->nclasses < 256)
+                ac->class_of[b] = ac->nclasses++;
+        }
+    }
+
+    if (total >= WB_AC_MATCH)
+        return -E2BIG;
+
+    ac->next = kvcalloc(total * ac->nclasses, sizeof(*ac->next), GFP_KERNEL);
+    ac->out = kvcalloc(total, sizeof(*ac->out), GFP_KERNEL);
+    ac->depth = kvcalloc(total, sizeof(*ac->depth), GFP_KERNEL);
+    fail = kvcalloc(total, sizeof(*fail), GFP_KERNEL);
+    queue = kvcalloc(total, sizeof(*queue), GFP_KERNEL);
+    if (!ac->next || !ac->out || !ac->depth || !fail || !queue)
+        goto nomem;
+
+    /* Build the trie; state 0 is the root and never a child */
+    ac->nstates = 1;
+    for (i = 0; i < count; i++) {
+        u16 s = 0;
+
+        for (j = 0; j < lens[i]; j++) {
+            u16 *t = &ac->next[(size_t)s * ac->nclasses +
+                               ac->class_of[patterns[i][j]]];
+            if (!*t) {
+                ac->depth[ac->nstates] = j + 1;
+                *t = ac->nstates++;
+            }
+            s = *t;
+        }
+        ac->out[s] |= BIT(i);
+    }
+
+    /* Resolve failure links breadth-first and complete the table */
+    for (c = 0; c < ac->nclasses; c++) {
+        u16 t = ac->next[c];
+
+        if (t)
+            queue[tail++] = t;
+    }
+
+    while (head < tail) {
+        u16 s = queue[head++];
+        u16 *row = &ac->next[(size_t)s * ac->nclasses];
+        const u16 *frow = &ac->next[(size_t)fail[s] * ac->nclasses];
+
+        ac->out[s] |= ac->out[fail[s]];
+
+        for (c = 0; c < ac->nclasses; c++) {
+            if (row[c]) {
+                fail[row[c]] = frow[c];
+                queue[tail++] = row[c];
+            } else {
+                row[c] = frow[c];
+            }
+        }
+    }
+
+    /* Tag transitions into accepting states so the scan loop stays flat */
+    for (j = 0; j < (size_t)ac->nstates * ac->nclasses; j++) {
+        if (ac->out[ac->next[j]])
+            ac->next[j] |= WB_AC_MATCH;
+    }
+
+    kvfree(queue);
+    kvfree(fail);
+    return 0;
+
+nomem:
+    kvfree(queue);
+    kvfree(fail);
+    wb_ac_free(ac);
+    return -ENOMEM;
+}
+
+void wb_ac_free(struct wb_ac *ac)
+{
+    kvfree(ac->next);
+    kvfree(ac->out);
+    kvfree(ac->depth);
+    ac->next = NULL;
+    ac->out = NULL;
+    ac->depth = NULL;
+    ac->nstates = 0;
+}
+
+/*
+ * Stream a buffer through the automaton.
+ *
+ * The state is carried across calls, so a payload split over several
+ * buffers is matched exactly as if it were contiguous. Returns the mask
+ * of wanted patterns completed at the first byte that completes any of
+ * them, or 0.
+ */
+u32 wb_ac_feed(const struct wb_ac *ac, u16 *state,
+               const u8 *buf, size_t len, u32 want)
+{
+    u16 s = *state;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        s = wb_ac_step(ac, s, buf[i]);
+        if (unlikely(s & WB_AC_MATCH)) {
+            s &= ~WB_AC_MATCH;
+            if (ac->out[s] & want) {
+                *state = s;
+                return ac->out[s] & want;
+            }
+        }
+    }
+
+    *state = s;
+    return 0;
+}
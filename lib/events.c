@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: binary event stream on /dev/wrong8007
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/string.h>
+
+#include <wrong8007.h>
+#include <events.h>
+
+static unsigned int event_ring = 4096;
+module_param(event_ring, uint, 0000);
+MODULE_PARM_DESC(event_ring, "events buffered per CPU for /dev/wrong8007 (power of two, default 4096)");
+
+/*
+ * Per-CPU event ring.
+ *
+ * The local CPU is the only producer, with interrupts disabled so that
+ * nested contexts cannot interleave; the reader is the only consumer.
+ * A full ring drops the new event and counts it, so producers never
+ * wait and the reader learns how much it missed.
+ */
+struct wb_ev_ring {
+    unsigned int head;          /* written by the producer */
+    unsigned int tail;          /* written by the reader */
+    unsigned long lost;         /* written by the producer */
+    unsigned long lost_seen;    /* reader's copy of lost */
+    struct wb_event ev[];
+};
+
+DEFINE_STATIC_KEY_FALSE(wb_events_key);
+unsigned long wb_events_epoch;
+
+static DEFINE_PER_CPU(struct wb_ev_ring *, wb_ev_ring);
+static DECLARE_WAIT_QUEUE_HEAD(wb_ev_wait);
+static DEFINE_MUTEX(wb_ev_lock);            /* reader side, ring allocation */
+static atomic_t wb_ev_open = ATOMIC_INIT(0);
+static bool wb_ev_allocated;
+static unsigned int wb_ev_mask;
+
+void __wb_event(u16 type, u8 source, u64 a0, u64 a1,
+                const void *tag, size_t tag_len)
+{
+    struct wb_ev_ring *r;
+    struct wb_event *e;
+    unsigned long flags;
+    unsigned int head;
+
+    local_irq_save(flags);
+
+    r = this_cpu_read(wb_ev_ring);
+    head = r->head;
+    if (head - smp_load_acquire(&r->tail) > wb_ev_mask) {
+        r->lost++;
+        local_irq_restore(flags);
+        return;
+    }
+
+    e = &r->ev[head & wb_ev_mask];
+    e->ts_ns = ktime_get_ns();
+    e->type = type;
+    e->source = source;
+    e->pad = 0;
+    e->cpu = smp_processor_id();
+    e->arg[0] = a0;
+    e->arg[1] = a1;
+    memset(e->tag, 0, sizeof(e->tag));
+    if (tag)
+        memcpy(e->tag, tag, min(tag_len, sizeof(e->tag)));
+
+    smp_store_release(&r->head, head + 1);
+    local_irq_restore(flags);
+
+    /* Implies the barrier that pairs with the reader's sleep */
+    if (wq_has_sleeper(&wb_ev_wait))
+        wake_up_interruptible(&wb_ev_wait);
+}
+
+static bool wb_ev_pending(void)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct wb_ev_ring *r = per_cpu(wb_ev_ring, cpu);
+
+        if (READ_ONCE(r->head) != r->tail ||
+            READ_ONCE(r->lost) != r->lost_seen)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Copy whole records from every ring into the user buffer. A CPU that
+ * dropped events reports it first, in place of the missing records.
+ */
+static ssize_t wb_ev_drain(char __user *buf, size_t len)
+{
+    size_t room = len / sizeof(struct wb_event);
+    size_t done = 0;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct wb_ev_ring *r = per_cpu(wb_ev_ring, cpu);
+        unsigned long lost = READ_ONCE(r->lost);
+        unsigned int tail = r->tail;
+        unsigned int head;
+
+        if (lost != r->lost_seen && done < room) {
+            struct wb_event e = {
+                .ts_ns = ktime_get_ns(),
+                .type = WB_EV_LOST,
+                .source = WB_EV_NO_SOURCE,
+                .cpu = cpu,
+                .arg = { lost - r->lost_seen },
+            };
+
+            if (copy_to_user(buf + done * sizeof(e), &e, sizeof(e)))
+                return -EFAULT;
+            r->lost_seen = lost;
+            done++;
+        }
+
+        head = smp_load_acquire(&r->head);
+        while (tail != head && done < room) {
+            /* Contiguous run up to the end of the ring */
+            size_t n = min3((size_t)(head - tail),
+                            (size_t)(wb_ev_mask + 1 - (tail & wb_ev_mask)),
+                            room - done);
+
+            if (copy_to_user(buf + done * sizeof(struct wb_event),
+                             &r->ev[tail & wb_ev_mask],
+                             n * sizeof(struct wb_event)))
+                return -EFAULT;
+            tail += n;
+            done += n;
+        }
+
+        smp_store_release(&r->tail, tail);
+    }
+
+    return done * sizeof(struct wb_event);
+}
+
+static ssize_t wb_ev_read(struct file *file, char __user *buf,
+                          size_t len, loff_t *ppos)
+{
+    ssize_t ret;
+
+    if (len < sizeof(struct wb_event))
+        return -EINVAL;
+
+    for (;;) {
+        mutex_lock(&wb_ev_lock);
+        ret = wb_ev_drain(buf, len);
+        mutex_unlock(&wb_ev_lock);
+
+        if (ret)
+            return ret;
+
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+
+        ret = wait_event_interruptible(wb_ev_wait, wb_ev_pending());
+        if (ret)
+            return ret;
+    }
+}
+
+static __poll_t wb_ev_poll(struct file *file, poll_table *wait)
+{
+    poll_wait(file, &wb_ev_wait, wait);
+
+    return wb_ev_pending() ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+/*
+ * Rings are allocated on first open and kept until unload, so a module
+ * that is never monitored costs no memory.
+ */
+static int wb_ev_alloc(void)
+{
+    size_t size = struct_size((struct wb_ev_ring *)NULL, ev, wb_ev_mask + 1);
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct wb_ev_ring *r = kvzalloc_node(size, GFP_KERNEL, cpu_to_node(cpu));
+
+        if (!r)
+            return -ENOMEM;
+        per_cpu(wb_ev_ring, cpu) = r;
+    }
+
+    wb_ev_allocated = true;
+    return 0;
+}
+
+static void wb_ev_free(void)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        kvfree(per_cpu(wb_ev_ring, cpu));
+        per_cpu(wb_ev_ring, cpu) = NULL;
+    }
+
+    wb_ev_allocated = false;
+}
+
+/*
+ * A single reader at a time: the rings have one consumer.
+ */
+static int wb_ev_open_fn(struct inode *inode, struct file *file)
+{
+    int ret = 0;
+    int cpu;
+
+    if (atomic_cmpxchg(&wb_ev_open, 0, 1))
+        return -EBUSY;
+
+    mutex_lock(&wb_ev_lock);
+    if (!wb_ev_allocated) {
+        ret = wb_ev_alloc();
+        if (ret)
+            wb_ev_free();
+    }
+
+    /* Start from an empty stream; the producers are switched off */
+    if (!ret) {
+        for_each_possible_cpu(cpu) {
+            struct wb_ev_ring *r = per_cpu(wb_ev_ring, cpu);
+
+            r->tail = READ_ONCE(r->head);
+            r->lost_seen = READ_ONCE(r->lost);
+        }
+    }
+    mutex_unlock(&wb_ev_lock);
+
+    if (ret) {
+        atomic_set(&wb_ev_open, 0);
+        return ret;
+    }
+
+    WRITE_ONCE(wb_events_epoch, jiffies);
+    static_branch_enable(&wb_events_key);
+    return nonseekable_open(inode, file);
+}
+
+static int wb_ev_release(struct inode *inode, struct file *file)
+{
+    static_branch_disable(&wb_events_key);
+    atomic_set(&wb_ev_open, 0);
+    return 0;
+}
+
+static const struct file_operations wb_ev_fops = {
+    .owner = THIS_MODULE,
+    .open = wb_ev_open_fn,
+    .release = wb_ev_release,
+    .read = wb_ev_read,
+    .poll = wb_ev_poll,
+    .llseek = noop_llseek,
+};
+
+static struct miscdevice wb_ev_dev = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name = "wrong8007",
+    .fops = &wb_ev_fops,
+    .mode = 0600,
+};
+
+int wb_events_init(void)
+{
+    int ret;
+
+    if (event_ring < 64 || !is_power_of_2(event_ring)) {
+        wb_err("event_ring must be a power of two >= 64\n");
+        return -EINVAL;
+    }
+    wb_ev_mask = event_ring - 1;
+
+    ret = misc_register(&wb_ev_dev);
+    if (ret)
+        wb_err("failed to register /dev/wrong8007 (err=%d)\n", ret);
+    return ret;
+}
+
+void wb_events_exit(void)
+{
+    misc_deregister(&wb_ev_dev);
+    wb_ev_free();
+}
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: activation latency accounting
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#include <linux/ktime.h>
+#include <linux/bitops.h>
+#include <linux/seq_file.h>
+
+#include <wrong8007.h>
+#include <latency.h>
+
+static const char *const stage_names[WB_STAGE_COUNT] = {
+    [WB_STAGE_MATCH]    = "match",
+    [WB_STAGE_ACTIVATE] = "activate",
+    [WB_STAGE_WORK]     = "work",
+    [WB_STAGE_EXEC]     = "exec",
+    [WB_STAGE_EXIT]     = "exit",
+};
+
+/*
+ * Timestamps of the current activation and a histogram of the delay
+ * between each stage and the one before it. Execution is one-shot per
+ * load, so each histogram column holds at most one sample and is lost
+ * on unload; distributions come from repeated loads, as in
+ * tests/bench_exec_latency.sh.
+ *
+ * Stages of one activation are marked one after another, each from the
+ * context that caused the next (trigger, workqueue, helper), so the
+ * writers never overlap and no lock is needed.
+ */
+static u64 stamps[WB_STAGE_COUNT];
+static enum wb_source stamp_src;
+static u32 hist[WB_STAGE_COUNT - 1][WB_LAT_BUCKETS];
+
+/*
+ * Start a new activation at the moment its trigger detected the match,
+ * which may be well before wrong8007_activate() runs (USB debounce,
+ * heartbeat timer expiry).
+ */
+void wb_latency_match(enum wb_source src, ktime_t at)
+{
+    memset(stamps, 0, sizeof(stamps));
+    WRITE_ONCE(stamp_src, src);
+    WRITE_ONCE(stamps[WB_STAGE_MATCH], ktime_to_ns(at));
+}
+
+void wb_latency_mark(enum wb_stage stage, enum wb_source src)
+{
+    u64 now = ktime_get_ns();
+    u64 prev = stamps[stage - 1];
+    u64 delta;
+    unsigned int b;
+
+    WRITE_ONCE(stamps[stage], now);
+
+    if (!prev)
+        return;
+
+    delta = now > prev ? now - prev : 0;
+    b = delta ? min_t(unsigned int, fls64(delta) - 1, WB_LAT_BUCKETS - 1) : 0;
+    WRITE_ONCE(hist[stage - 1][b], hist[stage - 1][b] + 1);
+}
+
+static int latency_show(struct seq_file *m, void *v)
+{
+    unsigned int s, b;
+
+    if (!READ_ONCE(stamps[WB_STAGE_MATCH])) {
+        seq_puts(m, "no activation\n");
+        return 0;
+    }
+
+    seq_printf(m, "source: %s\n", wb_source_name(READ_ONCE(stamp_src)));
+
+    for (s = 1; s < WB_STAGE_COUNT; s++) {
+        u64 prev = READ_ONCE(stamps[s - 1]);
+        u64 cur = READ_ONCE(stamps[s]);
+
+        seq_printf(m, "%-8s -> %-8s ", stage_names[s - 1], stage_names[s]);
+        if (prev && cur)
+            seq_printf(m, "%12llu ns\n", cur - prev);
+        else
+            seq_puts(m, "           - ns\n");
+    }
+
+    seq_puts(m, "\nhistogram (ns)");
+    for (s = 1; s < WB_STAGE_COUNT; s++)
+        seq_printf(m, " %8s", stage_names[s]);
+    seq_putc(m, '\n');
+
+    for (b = 0; b < WB_LAT_BUCKETS; b++) {
+        u32 row = 0;
+
+        for (s = 0; s < WB_STAGE_COUNT - 1; s++)
+            row |= READ_ONCE(hist[s][b]);
+        if (!row)
+            continue;
+
+        seq_printf(m, ">= %-11llu", b ? 1ULL << b : 0ULL);
+        for (s = 0; s < WB_STAGE_COUNT - 1; s++)
+            seq_printf(m, " %8u", READ_ONCE(hist[s][b]));
+        seq_putc(m, '\n');
+    }
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(latency);
+
+void wb_latency_debugfs(struct dentry *dir)
+{
+    debugfs_create_file("latency", 0400, dir, NULL, &latency_fops);
+}
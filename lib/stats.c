@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: per-CPU event counters
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#include <linux/cpumask.h>
+#include <linux/seq_file.h>
+
+#include <wrong8007.h>
+#include <stats.h>
+
+DEFINE_PER_CPU(struct wb_counters, wb_counters_pcpu);
+
+static const char *const counter_names[WB_CNT_COUNT] = {
+    [WB_CNT_NET_PACKETS]       = "net_packets",
+    [WB_CNT_NET_L3_FAIL]       = "net_l3_pull_failed",
+    [WB_CNT_NET_L4_FAIL]       = "net_l4_pull_failed",
+    [WB_CNT_NET_HEARTBEAT]     = "net_heartbeats",
+    [WB_CNT_NET_HB_BAD]        = "net_heartbeat_bad",
+    [WB_CNT_NET_HB_REPLAY]     = "net_heartbeat_replays",
+    [WB_CNT_NET_RULE_HIT]      = "net_rule_hits",
+    [WB_CNT_NET_PAYLOAD_SCANS] = "net_payload_scans",
+    [WB_CNT_NET_PAYLOAD_BYTES] = "net_payload_bytes",
+    [WB_CNT_NET_PAYLOAD_HIT]   = "net_payload_hits",
+    [WB_CNT_KBD_EVENTS]        = "kbd_events",
+    [WB_CNT_KBD_CHARS]         = "kbd_chars",
+    [WB_CNT_KBD_HIT]           = "kbd_hits",
+    [WB_CNT_USB_EVENTS]        = "usb_events",
+    [WB_CNT_USB_HIT]           = "usb_hits",
+    [WB_CNT_USB_COALESCED]     = "usb_coalesced",
+    [WB_CNT_USB_RING_FULL]     = "usb_ring_full",
+    [WB_CNT_INPUT_EVENTS]      = "input_events",
+    [WB_CNT_INPUT_HIT]         = "input_hits",
+};
+
+/*
+ * Sum the per-CPU counters. Readers may see a CPU mid-update, which
+ * only skews the snapshot by the events in flight.
+ */
+static int stats_show(struct seq_file *m, void *v)
+{
+    unsigned int s;
+    int cpu;
+
+    for (s = 0; s < WB_CNT_COUNT; s++) {
+        u64 sum = 0;
+
+        for_each_possible_cpu(cpu)
+            sum += READ_ONCE(per_cpu(wb_counters_pcpu, cpu).v[s]);
+
+        seq_printf(m, "%-20s %llu\n", counter_names[s], sum);
+    }
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(stats);
+
+void wb_counters_debugfs(struct dentry *dir)
+{
+    debugfs_create_file("stats", 0400, dir, NULL, &stats_fops);
+}
@@ -0,0 +1,96 @@
+#!/usr/bin/env bash
+# tests/bench_exec_latency.sh
+# Measure trigger-to-exec latency of the wrong8007 action
+#
+# Loads the module with a magic-packet rule on loopback, records the time
+# just before the packet is sent and compares it with the mtime of a file
+# touched by the action. Each run reloads the module, since execution is
+# one-shot. Runs on an idle host first, then with every CPU busy and a
+# writer keeping the system workqueues and block layer occupied.
+#
+# usage: tests/bench_exec_latency.sh [module.ko] [runs]
+
+set -euo pipefail
+
+MODULE="${1:-wrong8007.ko}"
+RUNS="${2:-20}"
+PORT=31337
+PAYLOAD="W8BENCH"
+STAMP="$(mktemp -u /tmp/wrong8007_stamp.XXXXXX)"
+LOAD_PIDS=()
+
+start_load() {
+    local cpu
+
+    for ((cpu = 0; cpu < $(nproc); cpu++)); do
+        taskset -c "$cpu" sh -c 'while :; do :; done' &
+        LOAD_PIDS+=("$!")
+    done
+
+    sh -c "while :; do dd if=/dev/zero of=$STAMP.load bs=1M count=64 conv=fsync 2> /dev/null; done" &
+    LOAD_PIDS+=("$!")
+}
+
+stop_load() {
+    [ "${#LOAD_PIDS[@]}" -gt 0 ] && kill "${LOAD_PIDS[@]}" 2> /dev/null || true
+    wait 2> /dev/null || true
+    LOAD_PIDS=()
+    rm -f "$STAMP.load"
+}
+
+cleanup() {
+    stop_load
+    sudo rmmod wrong8007 2> /dev/null || true
+    rm -f "$STAMP"
+}
+trap cleanup EXIT
+
+# Print one latency sample in microseconds
+sample() {
+    local direct="$1" sent fired
+
+    rm -f "$STAMP"
+    sudo insmod "$MODULE" exec="\"/usr/bin/touch $STAMP\"" exec_direct="$direct" \
+        net_rules="ip=127.0.0.1,port=$PORT,payload=0" match_payload="$PAYLOAD"
+
+    sent=$(date +%s%N)
+    printf '%s' "$PAYLOAD" > "/dev/udp/127.0.0.1/$PORT"
+
+    for _ in $(seq 1 200); do
+        [ -e "$STAMP" ] && break
+        sleep 0.01
+    done
+    sudo rmmod wrong8007
+
+    if [ ! -e "$STAMP" ]; then
+        echo "[!] action did not run" >&2
+        return 1
+    fi
+
+    fired=$(stat -c %.9Y "$STAMP" | tr -d .)
+    echo $(((fired - sent) / 1000))
+}
+
+# Print min/median/p90/max of the samples read from stdin
+summarize() {
+    sort -n | awk '{ v[NR] = $1 }
+        END { printf "%8d %8d %8d %8d\n", v[1], v[int((NR + 1) / 2)], v[int(NR * 0.9 + 0.5)], v[NR] }'
+}
+
+echo "=== wrong8007 trigger-to-exec latency, us ($RUNS runs) ==="
+printf "%-8s %-7s %8s %8s %8s %8s\n" "host" "exec" "min" "median" "p90" "max"
+
+for host in idle busy; do
+    [ "$host" = busy ] && start_load
+
+    for direct in 0 1; do
+        mode=shell
+        [ "$direct" = 1 ] && mode=direct
+        read -r min med p90 max < <(for ((i = 0; i < RUNS; i++)); do sample "$direct"; done | summarize)
+        printf "%-8s %-7s %8s %8s %8s %8s\n" "$host" "$mode" "$min" "$med" "$p90" "$max"
+    done
+
+    stop_load
+done
+
+echo "=== Benchmark completed ==="
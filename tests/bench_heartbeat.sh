@@ -0,0 +1,96 @@
+#!/usr/bin/env bash
+# tests/bench_heartbeat.sh
+# Measure the per-packet cost of heartbeat verification
+#
+# Floods loopback with heartbeats from one pinned wrong8007ctl per CPU
+# and reads the average time spent in nf_hook_fn and in hb_verify (the
+# SipHash tag check and replay window) from the ftrace function profiler.
+# The forged run uses the wrong key, so every packet fails verification.
+#
+# usage: tests/bench_heartbeat.sh [module.ko] [packets-per-cpu] [cpus]
+
+set -euo pipefail
+
+MODULE="${1:-wrong8007.ko}"
+PACKETS="${2:-200000}"
+CPUS="${3:-$(nproc)}"
+PORT=40007
+KEY="000102030405060708090a0b0c0d0e0f"
+BADKEY="f0e0d0c0b0a090807060504030201000"
+CTL="$(realpath tools/wrong8007ctl)"
+STATS="/sys/kernel/debug/wrong8007/stats"
+TRACEFS="/sys/kernel/tracing"
+[ -d "$TRACEFS/trace_stat" ] || TRACEFS="/sys/kernel/debug/tracing"
+
+BASE="heartbeat_host=127.0.0.1 heartbeat_port=$PORT heartbeat_timeout=600"
+
+# name|module parameters|sender arguments
+CONFIGS=(
+    "plain|$BASE|-m heartbeat"
+    "authenticated|$BASE heartbeat_key=$KEY|-k $KEY"
+    "forged|$BASE heartbeat_key=$KEY|-k $BADKEY"
+)
+
+if [ ! -w "$TRACEFS/function_profile_enabled" ]; then
+    echo "[!] ftrace function profiler not available (CONFIG_FUNCTION_PROFILER)"
+    exit 1
+fi
+
+if [ ! -x "$CTL" ]; then
+    echo "[!] build tools/wrong8007ctl first (make -C tools)"
+    exit 1
+fi
+
+# Prints "hits avg_ns" for one profiled function
+func_avg_ns() {
+    # trace_stat columns: Function Hit Time Avg s^2
+    awk -v f="$1" '$1 == f { hits += $2; time += $3 }
+         END { if (hits) printf "%d %.1f\n", hits, time * 1000 / hits; else print "0 0" }' \
+        "$TRACEFS"/trace_stat/function*
+}
+
+stat_value() {
+    sudo awk -v k="$1" '$1 == k { print $2 }' "$STATS"
+}
+
+flood() {
+    local cpu
+
+    # Loopback traffic is received on the sending CPU
+    for ((cpu = 0; cpu < CPUS; cpu++)); do
+        # shellcheck disable=SC2086
+        taskset -c "$cpu" "$CTL" heartbeat 127.0.0.1 "$PORT" $1 \
+            -i 0 -n "$PACKETS" 2> /dev/null &
+    done
+    wait
+}
+
+echo "=== wrong8007 heartbeat verification cost ($PACKETS packets x $CPUS CPUs) ==="
+echo "[*] $(uname -r), $(grep -m1 'model name' /proc/cpuinfo | cut -d: -f2- | sed 's/^ *//'), module $(git rev-parse --short HEAD 2>/dev/null || echo unknown)"
+printf "%-14s %10s %10s %10s %10s %10s %10s\n" \
+    "config" "hook" "hook(ns)" "verify" "verify(ns)" "bad" "replays"
+
+for entry in "${CONFIGS[@]}"; do
+    IFS='|' read -r name params sender <<< "$entry"
+
+    # shellcheck disable=SC2086
+    sudo insmod "$MODULE" exec=/bin/true $params
+
+    printf "nf_hook_fn\nhb_verify\n" | sudo tee "$TRACEFS/set_ftrace_filter" > /dev/null
+    echo 0 | sudo tee "$TRACEFS/function_profile_enabled" > /dev/null
+    echo 1 | sudo tee "$TRACEFS/function_profile_enabled" > /dev/null
+
+    flood "$sender"
+
+    echo 0 | sudo tee "$TRACEFS/function_profile_enabled" > /dev/null
+    read -r hook_hits hook_avg < <(func_avg_ns nf_hook_fn)
+    read -r verify_hits verify_avg < <(func_avg_ns hb_verify)
+    printf "%-14s %10s %10s %10s %10s %10s %10s\n" "$name" \
+        "$hook_hits" "$hook_avg" "$verify_hits" "$verify_avg" \
+        "$(stat_value net_heartbeat_bad)" "$(stat_value net_heartbeat_replays)"
+
+    echo | sudo tee "$TRACEFS/set_ftrace_filter" > /dev/null
+    sudo rmmod wrong8007
+done
+
+echo "=== Benchmark completed ==="
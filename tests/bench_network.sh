@@ -0,0 +1,82 @@
+#!/usr/bin/env bash
+# tests/bench_network.sh
+# Measure the per-packet cost of the wrong8007 netfilter hook
+#
+# Loads the module once per configuration, floods loopback from one
+# pinned sender per CPU and reads the average time spent in nf_hook_fn
+# from the ftrace function profiler. Run it against two builds to compare
+# before/after numbers.
+#
+# usage: tests/bench_network.sh [module.ko] [packets-per-cpu] [cpus]
+
+set -euo pipefail
+
+MODULE="${1:-wrong8007.ko}"
+PACKETS="${2:-200000}"
+CPUS="${3:-$(nproc)}"
+TRACEFS="/sys/kernel/tracing"
+[ -d "$TRACEFS/trace_stat" ] || TRACEFS="/sys/kernel/debug/tracing"
+
+# A thousand /32 rules plus a /16, none covering loopback
+RULES="ip=198.51.0.0/16,port=1,payload=0"
+for ((i = 0; i < 1000; i++)); do
+    RULES+=";ip=10.$((i / 256)).$((i % 256)).1,proto=udp,port=1-1024"
+done
+
+# Configurations to compare; none of them may fire on loopback traffic.
+# The last one treats every packet as a heartbeat, so all CPUs hit the
+# heartbeat path concurrently.
+CONFIGS=(
+    "match_port=1 match_payload=MAGIC"
+    "match_payload=MAGIC net_rules=$RULES"
+    "heartbeat_host=192.0.2.1 heartbeat_timeout=600"
+    "match_ip=192.0.2.1 match_port=1"
+    "match_mac=02:00:00:00:00:01 match_ip=192.0.2.1 match_port=1 match_payload=MAGIC"
+    "heartbeat_host=127.0.0.1 heartbeat_timeout=600"
+)
+
+if [ ! -w "$TRACEFS/function_profile_enabled" ]; then
+    echo "[!] ftrace function profiler not available (CONFIG_FUNCTION_PROFILER)"
+    exit 1
+fi
+
+hook_avg_ns() {
+    # trace_stat columns: Function Hit Time Avg s^2
+    awk '$1 == "nf_hook_fn" { hits += $2; time += $3 }
+         END { if (hits) printf "%d %.1f\n", hits, time * 1000 / hits; else print "0 0" }' \
+        "$TRACEFS"/trace_stat/function*
+}
+
+flood() {
+    local cpu
+
+    # Loopback traffic is received on the sending CPU
+    for ((cpu = 0; cpu < CPUS; cpu++)); do
+        sudo taskset -c "$cpu" ping -f -q -c "$PACKETS" 127.0.0.1 > /dev/null &
+    done
+    wait
+}
+
+echo "=== wrong8007 nf_hook_fn per-packet cost ($PACKETS packets x $CPUS CPUs) ==="
+echo "[*] $(uname -r), $(grep -m1 'model name' /proc/cpuinfo | cut -d: -f2- | sed 's/^ *//'), module $(git rev-parse --short HEAD 2>/dev/null || echo unknown)"
+printf "%-80s %10s %10s\n" "config" "hits" "avg(ns)"
+
+for cfg in "${CONFIGS[@]}"; do
+    # shellcheck disable=SC2086
+    sudo insmod "$MODULE" exec=/bin/true $cfg
+
+    echo nf_hook_fn | sudo tee "$TRACEFS/set_ftrace_filter" > /dev/null
+    echo 0 | sudo tee "$TRACEFS/function_profile_enabled" > /dev/null
+    echo 1 | sudo tee "$TRACEFS/function_profile_enabled" > /dev/null
+
+    flood
+
+    echo 0 | sudo tee "$TRACEFS/function_profile_enabled" > /dev/null
+    read -r hits avg < <(hook_avg_ns)
+    printf "%-80s %10s %10s\n" "${cfg:0:80}" "$hits" "$avg"
+
+    echo | sudo tee "$TRACEFS/set_ftrace_filter" > /dev/null
+    sudo rmmod wrong8007
+done
+
+echo "=== Benchmark completed ==="
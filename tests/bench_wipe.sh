@@ -0,0 +1,81 @@
+#!/usr/bin/env bash
+# tests/bench_wipe.sh
+# Compare actions/wipe-example.sh with 'wrong8007ctl wipe' on loop devices
+#
+# Each round formats the loop devices (ext4, or a LUKS1 header when
+# cryptsetup is available) and times one wipe method. The shell payload
+# runs the same per-device commands as actions/wipe-example.sh, pointed
+# at the loop devices instead of /dev/sd* and /dev/nvme*.
+#
+# usage: tests/bench_wipe.sh [devices] [size-MiB] [rounds]
+
+set -euo pipefail
+
+NDEVS="${1:-4}"
+SIZE_MIB="${2:-1024}"
+ROUNDS="${3:-3}"
+CTL="$(realpath tools/wrong8007ctl)"
+WORKDIR="$(mktemp -d)"
+LOOPS=()
+
+cleanup() {
+    for dev in "${LOOPS[@]}"; do
+        sudo losetup -d "$dev" 2>/dev/null || true
+    done
+    rm -rf "$WORKDIR"
+}
+trap cleanup EXIT
+
+for ((i = 0; i < NDEVS; i++)); do
+    truncate -s "${SIZE_MIB}M" "$WORKDIR/disk$i.img"
+    LOOPS+=("$(sudo losetup -f --show "$WORKDIR/disk$i.img")")
+done
+
+prepare() {
+    local dev
+    for dev in "${LOOPS[@]}"; do
+        if command -v cryptsetup > /dev/null; then
+            echo -n "bench" | sudo cryptsetup luksFormat --type luks1 -q "$dev" -
+        else
+            sudo mkfs.ext4 -q -F "$dev"
+        fi
+    done
+    sync
+}
+
+shell_payload() {
+    # Body of actions/wipe-example.sh
+    printf '%s\n' "${LOOPS[@]}" | sudo xargs -rn1 -P4 bash -c '
+    device="$1"
+    [[ $(command -v wipefs) ]] && wipefs -af "$device" > /dev/null
+    [[ $(command -v sgdisk) ]] && sgdisk -Z "$device" > /dev/null
+    dd if=/dev/zero of="$device" bs=1M count=4 conv=fsync status=none
+    ' _
+}
+
+METHODS=(
+    "wipe-example.sh|shell_payload"
+    "wrong8007ctl --headers-only|sudo $CTL wipe --yes --headers-only ${LOOPS[*]}"
+    "wrong8007ctl (headers + bulk)|sudo $CTL wipe --yes ${LOOPS[*]}"
+)
+
+echo "=== Wipe benchmark ($NDEVS x $SIZE_MIB MiB loop devices, $ROUNDS rounds) ==="
+printf "%-32s %12s\n" "method" "avg(ms)"
+
+for method in "${METHODS[@]}"; do
+    name="${method%%|*}"
+    cmd="${method#*|}"
+    total=0
+
+    for ((r = 0; r < ROUNDS; r++)); do
+        prepare
+        start=$(date +%s%N)
+        eval "$cmd" > /dev/null 2>&1
+        end=$(date +%s%N)
+        total=$((total + (end - start) / 1000))
+    done
+
+    awk -v n="$name" -v t="$total" -v r="$ROUNDS" 'BEGIN { printf "%-32s %12.1f\n", n, t / r / 1000 }'
+done
+
+echo "=== Benchmark completed ==="
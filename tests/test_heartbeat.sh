@@ -0,0 +1,163 @@
+#!/usr/bin/env bash
+# tests/test_heartbeat.sh
+# Verify heartbeat quorum expiry and its timing over loopback
+#
+# Three hosts are configured and two of them are required. Heartbeats
+# from two hosts must keep the trigger quiet; once only one is left the
+# trigger must fire within the timeout.
+#
+# With heartbeat_key set, heartbeats from a live station replayed with
+# a dead station's source address must be rejected, so the quorum is
+# lost and the trigger fires.
+#
+# The jitter check then measures, over several loads, how long after a
+# single heartbeat a sub-second timeout fires. It must never fire early,
+# and never later than JITTER_MAX_MS (default 100) past the deadline.
+
+set -euo pipefail
+
+MODULE_NAME="wrong8007.ko"
+TEST_EXEC="$(realpath tests/test_exec.sh)"
+LOG_FILE="/tmp/trigger_test.log"
+CTL="$(realpath tools/wrong8007ctl)"
+PORT=40007
+TIMEOUT=3
+TIMEOUT_MS=300
+RUNS="${RUNS:-10}"
+JITTER_MAX_MS="${JITTER_MAX_MS:-100}"
+STAMP="$(mktemp -u /tmp/wrong8007_hb.XXXXXX)"
+SENDERS=()
+
+cleanup() {
+    [ ${#SENDERS[@]} -gt 0 ] && kill "${SENDERS[@]}" 2>/dev/null || true
+    sudo rmmod wrong8007 2>/dev/null || true
+    rm -f "$STAMP"
+}
+trap cleanup EXIT
+
+log_lines() {
+    [ -f "$LOG_FILE" ] && wc -l < "$LOG_FILE" || echo 0
+}
+
+# Send one heartbeat per second from a loopback address
+start_sender() {
+    "$CTL" heartbeat 127.0.0.1 "$PORT" -i 1 -b "$1" 2>/dev/null &
+    SENDERS+=($!)
+}
+
+echo "=== Heartbeat trigger test: 2 of 3 hosts ==="
+sudo insmod "$MODULE_NAME" exec="$TEST_EXEC" \
+    heartbeat_host=127.0.0.2,127.0.0.3,127.0.0.4 heartbeat_quorum=2 \
+    heartbeat_port="$PORT" heartbeat_timeout="$TIMEOUT"
+before=$(log_lines)
+
+echo "[*] Heartbeats from two of three hosts (must stay quiet)"
+start_sender 127.0.0.2
+start_sender 127.0.0.3
+sleep $((TIMEOUT * 2))
+if [ "$(log_lines)" != "$before" ]; then
+    echo "[!] Trigger fired with the quorum met"
+    exit 1
+fi
+echo "[+] Quorum held"
+
+echo "[*] Stopping one host (quorum lost)"
+kill "${SENDERS[1]}"
+sleep $((TIMEOUT + 2))
+if [ "$(log_lines)" = "$before" ]; then
+    echo "[!] Trigger did not fire after losing the quorum"
+    exit 1
+fi
+echo "[+] Trigger fired: heartbeat quorum lost"
+sudo rmmod wrong8007
+
+echo "=== Heartbeat trigger test: replay from a spoofed station ==="
+KEY="000102030405060708090a0b0c0d0e0f"
+STATS="/sys/kernel/debug/wrong8007/stats"
+sudo insmod "$MODULE_NAME" exec="$TEST_EXEC" \
+    heartbeat_host=127.0.0.2,127.0.0.3 heartbeat_port="$PORT" \
+    heartbeat_key="$KEY" heartbeat_timeout="$TIMEOUT"
+before=$(log_lines)
+
+# A live station on 127.0.0.2; every heartbeat it sends is captured at
+# the port and replayed with the dead station's address, 127.0.0.3
+"$CTL" heartbeat 127.0.0.1 "$PORT" -i 1 -b 127.0.0.2 -k "$KEY" 2>/dev/null &
+SENDERS+=($!)
+python3 - "$PORT" "$((TIMEOUT * 2 + 2))" <<'PY' &
+import socket, sys, time
+port, duration = int(sys.argv[1]), float(sys.argv[2])
+rx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+rx.bind(("127.0.0.1", port))
+rx.settimeout(0.5)
+tx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+tx.bind(("127.0.0.3", 0))
+end = time.monotonic() + duration
+while time.monotonic() < end:
+    try:
+        data, src = rx.recvfrom(64)
+    except socket.timeout:
+        continue
+    if src[0] == "127.0.0.2":
+        tx.sendto(data, ("127.0.0.1", port))
+PY
+SENDERS+=($!)
+
+sleep $((TIMEOUT * 2 + 2))
+bad=$(sudo awk '$1 == "net_heartbeat_bad" { print $2 }' "$STATS")
+if [ "$(log_lines)" = "$before" ]; then
+    echo "[!] Replayed heartbeats kept the spoofed station alive"
+    exit 1
+fi
+if [ "${bad:-0}" -eq 0 ]; then
+    echo "[!] Replayed heartbeats were not rejected"
+    exit 1
+fi
+echo "[+] $bad replayed heartbeats rejected, trigger fired"
+kill "${SENDERS[@]}" 2>/dev/null || true
+SENDERS=()
+sudo rmmod wrong8007
+
+# Print how late the trigger fired after one heartbeat, in microseconds
+lateness_us() {
+    local sent fired
+
+    rm -f "$STAMP"
+    sudo insmod "$MODULE_NAME" exec="\"/usr/bin/touch $STAMP\"" exec_direct=1 \
+        heartbeat_host=127.0.0.2 heartbeat_port="$PORT" heartbeat_timeout_ms="$TIMEOUT_MS"
+
+    # Taken before sending, so the packet can only arrive later
+    sent=$(date +%s%N)
+    "$CTL" heartbeat 127.0.0.1 "$PORT" -b 127.0.0.2 -i 0 -n 1 2>/dev/null
+
+    for _ in $(seq 1 200); do
+        [ -e "$STAMP" ] && break
+        sleep 0.01
+    done
+    sudo rmmod wrong8007
+
+    if [ ! -e "$STAMP" ]; then
+        echo "[!] Trigger did not fire after the heartbeat stopped" >&2
+        return 1
+    fi
+
+    fired=$(stat -c %.9Y "$STAMP" | tr -d .)
+    echo $(((fired - sent) / 1000 - TIMEOUT_MS * 1000))
+}
+
+echo "=== Heartbeat trigger test: expiry jitter (${TIMEOUT_MS} ms timeout, $RUNS runs) ==="
+samples=$(for ((i = 0; i < RUNS; i++)); do lateness_us; done | sort -n)
+min=$(head -n 1 <<< "$samples")
+max=$(tail -n 1 <<< "$samples")
+echo "[*] Lateness after the deadline: min ${min} us, max ${max} us, jitter $((max - min)) us"
+
+if [ "$min" -lt 0 ]; then
+    echo "[!] Trigger fired before the deadline"
+    exit 1
+fi
+if [ "$max" -gt $((JITTER_MAX_MS * 1000)) ]; then
+    echo "[!] Trigger fired more than ${JITTER_MAX_MS} ms late"
+    exit 1
+fi
+echo "[+] Expiry within ${JITTER_MAX_MS} ms of the deadline"
+
+echo "=== Heartbeat trigger test completed successfully ==="
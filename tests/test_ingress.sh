@@ -0,0 +1,78 @@
+#!/usr/bin/env bash
+# tests/test_ingress.sh
+# Verify the ingress-mode network trigger on a veth pair
+#
+# The module hooks only w8veth0. A magic packet on loopback must be
+# ignored, the same packet arriving on w8veth0 from a peer namespace
+# must fire the trigger. ARP on the hooked interface is not an IP
+# header pull failure.
+
+set -euo pipefail
+
+MODULE_NAME="wrong8007.ko"
+TEST_EXEC="$(realpath tests/test_exec.sh)"
+LOG_FILE="/tmp/trigger_test.log"
+CTL="$(realpath tools/wrong8007ctl)"
+NETNS="w8test"
+PORT=4444
+PAYLOAD="MAGIC"
+STATS="/sys/kernel/debug/wrong8007/stats"
+
+cleanup() {
+    sudo rmmod wrong8007 2>/dev/null || true
+    sudo ip link del w8veth0 2>/dev/null || true
+    sudo ip netns del "$NETNS" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+log_lines() {
+    [ -f "$LOG_FILE" ] && wc -l < "$LOG_FILE" || echo 0
+}
+
+echo "=== Setting up veth pair ==="
+sudo ip netns add "$NETNS"
+sudo ip link add w8veth0 type veth peer name w8veth1
+sudo ip link set w8veth1 netns "$NETNS"
+sudo ip addr add 10.99.0.1/24 dev w8veth0
+sudo ip link set w8veth0 up
+sudo ip netns exec "$NETNS" ip addr add 10.99.0.2/24 dev w8veth1
+sudo ip netns exec "$NETNS" ip link set w8veth1 up
+
+echo "=== Loading module in ingress mode ==="
+sudo insmod "$MODULE_NAME" exec="$TEST_EXEC" ingress_dev=w8veth0 \
+    match_port="$PORT" match_payload="$PAYLOAD"
+
+before=$(log_lines)
+
+echo "[*] Sending magic packet on loopback (must be ignored)"
+"$CTL" send 127.0.0.1 "$PORT" "$PAYLOAD"
+sleep 1
+if [ "$(log_lines)" != "$before" ]; then
+    echo "[!] Trigger fired for traffic outside the hooked interface"
+    exit 1
+fi
+
+echo "[*] Sending magic packet through w8veth0"
+sudo ip netns exec "$NETNS" "$CTL" send 10.99.0.1 "$PORT" "$PAYLOAD"
+sleep 1
+if [ "$(log_lines)" = "$before" ]; then
+    echo "[!] Trigger did not fire on the hooked interface"
+    exit 1
+fi
+echo "[+] Ingress trigger fired"
+
+# The peer resolved 10.99.0.1 over ARP first; those frames crossed the
+# hook and must not be counted as failed IP header pulls
+failed=$(sudo awk '$1 == "net_l3_pull_failed" { print $2 }' "$STATS")
+if [ "${failed:-0}" -ne 0 ]; then
+    echo "[!] Non-IP frames counted as net_l3_pull_failed ($failed)"
+    exit 1
+fi
+echo "[+] ARP frames skipped without counting a pull failure"
+
+echo "[*] Removing hooked interface while loaded"
+sudo ip link del w8veth0
+sudo rmmod wrong8007
+echo "[+] Module unloaded after interface removal"
+
+echo "=== Ingress trigger test completed successfully ==="
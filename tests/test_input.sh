@@ -0,0 +1,80 @@
+#!/usr/bin/env bash
+# tests/test_input.sh
+# Verify the raw keycode trigger with a uinput virtual keyboard
+#
+# Wrong or incomplete input must be ignored; the exact sequence and the
+# full chord must each fire the trigger. A chord of fewer than two
+# distinct keys must be refused at load time.
+
+set -euo pipefail
+
+MODULE_NAME="wrong8007.ko"
+TEST_EXEC="$(realpath tests/test_exec.sh)"
+LOG_FILE="/tmp/trigger_test.log"
+CTL="$(realpath tools/wrong8007ctl)"
+
+# KEY_F9 KEY_F9 KEY_F10 and Ctrl+Alt+F12: harmless on a test machine
+SEQUENCE="67,67,68"
+CHORD="29+56+88"
+
+cleanup() {
+    sudo rmmod wrong8007 2>/dev/null || true
+}
+trap cleanup EXIT
+
+log_lines() {
+    [ -f "$LOG_FILE" ] && wc -l < "$LOG_FILE" || echo 0
+}
+
+expect_fired() {
+    sleep 1
+    if [ "$(log_lines)" = "$before" ]; then
+        echo "[!] Trigger did not fire: $1"
+        exit 1
+    fi
+    echo "[+] Trigger fired: $1"
+}
+
+expect_quiet() {
+    sleep 1
+    if [ "$(log_lines)" != "$before" ]; then
+        echo "[!] Trigger fired unexpectedly: $1"
+        exit 1
+    fi
+}
+
+sudo modprobe uinput
+
+echo "=== Input trigger test: key sequence ==="
+sudo insmod "$MODULE_NAME" exec="$TEST_EXEC" key_sequence="$SEQUENCE"
+before=$(log_lines)
+
+echo "[*] Pressing an incomplete sequence (must be ignored)"
+sudo "$CTL" keys 67 68
+expect_quiet "incomplete sequence"
+
+echo "[*] Pressing the sequence after a repeated prefix"
+sudo "$CTL" keys 67 67 67 68
+expect_fired "key sequence"
+sudo rmmod wrong8007
+
+echo "=== Input trigger test: key chord ==="
+echo "[*] Loading with a repeated key as the whole chord (must be rejected)"
+if sudo insmod "$MODULE_NAME" exec="$TEST_EXEC" key_chord="29+29" 2>/dev/null; then
+    echo "[!] key_chord '29+29' was accepted"
+    exit 1
+fi
+
+sudo insmod "$MODULE_NAME" exec="$TEST_EXEC" key_chord="$CHORD"
+before=$(log_lines)
+
+echo "[*] Pressing the chord keys one after another (must be ignored)"
+sudo "$CTL" keys 29 56 88
+expect_quiet "chord keys pressed in turn"
+
+echo "[*] Holding the chord"
+sudo "$CTL" keys --chord 29 56 88
+expect_fired "key chord"
+sudo rmmod wrong8007
+
+echo "=== Input trigger test completed successfully ==="
@@ -18,6 +18,19 @@ fi
 echo "=== Checking module list ==="
 lsmod | grep -q wrong8007 && echo "[*] Module appears in lsmod"
 
+echo "=== Checking tracepoints and debugfs ==="
+TRACEFS="/sys/kernel/tracing"
+[ -d "$TRACEFS/events" ] || TRACEFS="/sys/kernel/debug/tracing"
+for event in match activate work_start helper_exec helper_exit; do
+    if ! sudo test -d "$TRACEFS/events/wrong8007/wrong8007_$event"; then
+        echo "[!] Missing tracepoint wrong8007_$event"
+        exit 1
+    fi
+done
+sudo grep -q "no activation" /sys/kernel/debug/wrong8007/latency
+sudo grep -q "^net_packets" /sys/kernel/debug/wrong8007/stats
+echo "[*] Tracepoints, latency report and counters present"
+
 echo "=== Runtime Test: Unloading module ==="
 if sudo rmmod wrong8007; then
     echo "[+] Module unloaded successfully"
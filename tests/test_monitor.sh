@@ -0,0 +1,102 @@
+#!/usr/bin/env bash
+# tests/test_monitor.sh
+# Verify the /dev/wrong8007 event stream and `wrong8007ctl monitor`
+#
+# A monitor with packet events is started against a network trigger.
+# Loopback pings must show up as packet events, a runtime rule change as
+# a config event, and the magic payload as a match and an activation.
+# A ping flood then checks that per-packet events keep up, reporting how
+# many were delivered and how many the rings dropped.
+
+set -euo pipefail
+
+MODULE_NAME="wrong8007.ko"
+CTL="$(realpath tools/wrong8007ctl)"
+PARAMS="/sys/module/wrong8007/parameters"
+PORT=40008
+FLOOD="${FLOOD:-100000}"
+OUT="$(mktemp /tmp/wrong8007_monitor.XXXXXX)"
+ERR="$(mktemp /tmp/wrong8007_monitor.XXXXXX)"
+MONITOR=""
+
+cleanup() {
+    [ -n "$MONITOR" ] && sudo kill -INT "$MONITOR" 2>/dev/null || true
+    sudo rmmod wrong8007 2>/dev/null || true
+    rm -f "$OUT" "$ERR"
+}
+trap cleanup EXIT
+
+start_monitor() {
+    sudo "$CTL" monitor "$@" > "$OUT" 2> "$ERR" &
+    MONITOR=$!
+    sleep 0.5
+}
+
+stop_monitor() {
+    sudo kill -INT "$MONITOR"
+    wait "$MONITOR" || true
+    MONITOR=""
+}
+
+expect() {
+    if ! grep -q "$1" "$OUT"; then
+        echo "[!] missing $2 event"
+        cat "$OUT"
+        exit 1
+    fi
+    echo "[+] $2 event seen"
+}
+
+echo "=== Monitor test: event stream ==="
+sudo insmod "$MODULE_NAME" exec=/bin/true \
+    net_rules="ip=127.0.0.1,port=$PORT,payload=0" match_payload=MAGIC
+
+[ -c /dev/wrong8007 ] || { echo "[!] /dev/wrong8007 missing"; exit 1; }
+
+start_monitor -j -p
+
+# The rings have a single consumer
+if sudo "$CTL" monitor -n 1 2>/dev/null; then
+    echo "[!] second monitor was allowed to open the device"
+    exit 1
+fi
+echo "[+] Second reader refused"
+
+ping -c 3 -i 0.2 -q 127.0.0.1 > /dev/null
+echo "ip=127.0.0.1,port=$PORT,payload=0" | sudo tee "$PARAMS/net_rules" > /dev/null
+printf 'MAGIC' > "/dev/udp/127.0.0.1/$PORT"
+sleep 0.5
+stop_monitor
+
+expect '"type":"packet","source":"network","saddr":"127.0.0.1"' packet
+expect '"type":"config","source":"-","param":"net_rules"' config
+expect '"type":"match","source":"network"' match
+expect '"type":"activate","source":"network"' activate
+
+if [ "$(sudo cat "$PARAMS/event_packets")" != "N" ]; then
+    echo "[!] event_packets left enabled"
+    exit 1
+fi
+echo "[+] event_packets restored"
+sudo rmmod wrong8007
+
+echo "=== Monitor test: per-packet events under a flood ($FLOOD packets) ==="
+sudo insmod "$MODULE_NAME" exec=/bin/true match_port=1 match_payload=MAGIC
+start_monitor -p
+
+start=$(date +%s%N)
+sudo ping -f -q -c "$FLOOD" 127.0.0.1 > /dev/null
+elapsed_ms=$((($(date +%s%N) - start) / 1000000))
+sleep 0.5
+stop_monitor
+
+# "[+] N events, M lost"
+read -r events lost < <(awk '/events,/ { print $2, $4 }' "$ERR")
+echo "[*] $events events delivered, $lost lost in ${elapsed_ms} ms"
+if [ "$((events + lost))" -lt "$FLOOD" ]; then
+    echo "[!] fewer events than packets"
+    exit 1
+fi
+echo "[+] Every packet accounted for"
+
+echo "=== Monitor test passed ==="
@@ -15,6 +15,23 @@ sleep 2
 sudo make unload
 echo "Keyboard trigger smoke test passed"
 
+echo "=== Trigger test: Keyboard (multiple phrases) ==="
+sudo make load PHRASE="$PHRASE" PHRASES="burn it;nunuke" EXEC="$EXEC"
+sleep 2
+sudo make unload
+echo "Keyboard multi-phrase smoke test passed"
+
+echo "=== Trigger test: Keyboard (timing rules) ==="
+sudo make load PHRASE="$PHRASE" PHRASE_WINDOW_MS=2000 PHRASE_CADENCE="120,90,150" EXEC="$EXEC"
+echo "enroll" | sudo tee /sys/module/wrong8007/parameters/phrase_cadence > /dev/null
+# A profile that does not fit the phrase must be rejected
+if echo "100" | sudo tee /sys/module/wrong8007/parameters/phrase_cadence > /dev/null 2>&1; then
+    echo "[!] mismatched cadence was accepted"
+    exit 1
+fi
+sudo make unload
+echo "Keyboard timing smoke test passed"
+
 echo "=== Trigger test: USB ==="
 USB_DEVICES="1234:5678:any"
 WHITELIST=1
@@ -23,6 +40,43 @@ sleep 2
 sudo make unload
 echo "USB trigger smoke test passed"
 
+echo "=== Trigger test: USB (wildcards and conditions) ==="
+USB_RULES="1234:*:insert,class=09:eject,abcd:ef00:any:serial=W8TEST:mfr=wrong8007"
+for ((i = 0; i < 2000; i++)); do
+    USB_RULES+=",$(printf '%04x:%04x' $((0x2000 + i / 256)) $((i % 256)))"
+done
+sudo make load USB_DEVICES="$USB_RULES" WHITELIST=1 EXEC="$EXEC"
+sleep 2
+sudo make unload
+# A vendor-less rule without a class would match every device
+if sudo make load USB_DEVICES="*:*:insert" EXEC="$EXEC" 2>/dev/null; then
+    sudo make unload
+    echo "[!] catch-all USB rule was accepted"
+    exit 1
+fi
+echo "USB wildcard smoke test passed"
+
+echo "=== Trigger test: USB (class and lock state) ==="
+sudo make load USB_DEVICES="class=03:insert:locked,class=08:insert:locked" USB_DEBOUNCE_MS=200 EXEC="$EXEC"
+echo 1 | sudo tee /sys/module/wrong8007/parameters/host_locked > /dev/null
+echo 0 | sudo tee /sys/module/wrong8007/parameters/host_locked > /dev/null
+sudo make unload
+echo "USB class smoke test passed"
+
+echo "=== Trigger test: USB (port pinning) ==="
+sudo make load USB_DEVICES="path=1-3:1050:0407,path=2-1.4:class=08:insert,path=1-3.2.1:eject" EXEC="$EXEC"
+sleep 2
+sudo make unload
+# Port 0 does not exist and a pinned device needs both IDs
+for bad in "path=1-0" "path=1-3:1050:*"; do
+    if sudo make load USB_DEVICES="$bad" EXEC="$EXEC" 2>/dev/null; then
+        sudo make unload
+        echo "[!] invalid path rule '$bad' was accepted"
+        exit 1
+    fi
+done
+echo "USB port pinning smoke test passed"
+
 echo "=== Trigger test: Network (MAC) ==="
 MATCH_MAC="aa:bb:cc:dd:ee:ff"
 sudo make load MATCH_MAC="$MATCH_MAC" EXEC="$EXEC"
@@ -39,4 +93,35 @@ sleep 2
 sudo make unload
 echo "Network IP/port trigger smoke test passed"
 
+echo "=== Trigger test: Network (IPv6 + Magic Packet) ==="
+MATCH_IP="2001:db8::1"
+sudo make load MATCH_IP="$MATCH_IP" MATCH_PORT="$MATCH_PORT" MATCH_PAYLOAD="$MATCH_PAYLOAD" EXEC="$EXEC"
+sleep 2
+sudo make unload
+echo "Network IPv6/port trigger smoke test passed"
+
+echo "=== Trigger test: Network (rule table) ==="
+NET_RULES="ip=10.0.0.0/8,port=1000-2000,payload=0;ip=2001:db8::/32,proto=udp,payload=1;mac=aa:bb:cc:dd:ee:ff"
+sudo make load MATCH_PAYLOAD="MAGIC,MAGIC6" NET_RULES="$NET_RULES" EXEC="$EXEC"
+sleep 2
+sudo make unload
+echo "Network rule table smoke test passed"
+
+echo "=== Trigger test: Runtime updates ==="
+PARAMS="/sys/module/wrong8007/parameters"
+sudo make load PHRASE="$PHRASE" USB_DEVICES="$USB_DEVICES" MATCH_PAYLOAD="MAGIC" \
+    NET_RULES="ip=10.0.0.1,payload=0" EXEC="$EXEC"
+echo "wipe" | sudo tee "$PARAMS/phrase" > /dev/null
+echo "abcd:ef00:insert,1234:5678:eject" | sudo tee "$PARAMS/usb_devices" > /dev/null
+echo "ip=10.0.0.0/8,port=1234,payload=0" | sudo tee "$PARAMS/net_rules" > /dev/null
+[ "$(sudo cat "$PARAMS/phrase")" = "wipe" ]
+# Clearing a trigger at runtime must be refused, leaving the switch armed
+if echo "" | sudo tee "$PARAMS/phrase" > /dev/null 2>&1; then
+    echo "[!] empty phrase was accepted"
+    exit 1
+fi
+[ "$(sudo cat "$PARAMS/phrase")" = "wipe" ]
+sudo make unload
+echo "Runtime update smoke test passed"
+
 echo "=== All trigger smoke tests completed successfully ==="
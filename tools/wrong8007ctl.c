@@ -5,16 +5,22 @@
  *   heartbeat  Send periodic UDP heartbeat packets.
  *   send       Send a UDP trigger packet.
  *   usb-list   List removable USB devices and their VID:PID values.
+ *   keys       Inject raw keycodes through a virtual uinput keyboard.
+ *   wipe       Erase block devices in parallel, detected headers first.
+ *   monitor    Stream trigger events from /dev/wrong8007.
  *
  * No dependency beyond libc.
  */
 
-/* Request POSIX.1-2008 interfaces */
-#define _POSIX_C_SOURCE 200809L
+/* Request POSIX.1-2008 interfaces plus Linux extensions (sendmmsg) */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
 #include <unistd.h>
 #include <signal.h>
@@ -22,18 +28,39 @@
 #include <libgen.h>
 #include <limits.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netdb.h>
+#include <linux/uinput.h>
+#include <linux/fs.h>
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
 #define DEFAULT_HB_INTERVAL 10
 #define DEFAULT_HB_MESSAGE "heartbeat"
+#define HB_MAGIC "W8HB"
+#define HB_KEY_LEN 16
+#define HB_MSG_LEN 20 /* magic, counter, tag */
+#define HB_ADDRS_LEN 32 /* source and destination address, IPv4-mapped or IPv6 */
+#define HB_BATCH 1024 /* datagrams per sendmmsg call (UIO_MAXIOV) */
 #define DEFAULT_MAGIC_PAYLOAD "MAGIC"
 
 #define SYSFS_PATH_MAX (PATH_MAX + 32) /* Extra space for appending sysfs attribute names */
 #define MAX_PAYLOAD_LEN 1400 /* Conservative MTU-safe payload size */
+#define MAX_KEYS 32 /* Matches the kernel's key_sequence limit */
+#define DEFAULT_KEY_DELAY_MS 20
+
+#define MAX_WIPE_DEVICES 64
+#define DEFAULT_WIPE_HEAD_MIB 1 /* Generic head/tail on top of the detected structures */
+#define WIPE_DEV_LEN (5 + NAME_MAX + 1) /* "/dev/" + name */
+#define MIB ((uint64_t)1 << 20)
 
 /*
  * Userspace command definition.
@@ -130,17 +157,437 @@ static void udp_send(int fd, const struct sockaddr_in *dst,
         fprintf(stderr, "[!] short send: %zd/%zu bytes\n", n, len);
 }
 
+static uint16_t get_le16(const unsigned char *p) { return (uint16_t)(p[0] | p[1] << 8); }
+static uint32_t get_le32(const unsigned char *p) { return get_le16(p) | (uint32_t)get_le16(p + 2) << 16; }
+static uint64_t get_le64(const unsigned char *p) { return get_le32(p) | (uint64_t)get_le32(p + 4) << 32; }
+static uint16_t get_be16(const unsigned char *p) { return (uint16_t)(p[0] << 8 | p[1]); }
+static uint32_t get_be32(const unsigned char *p) { return (uint32_t)get_be16(p) << 16 | get_be16(p + 2); }
+static uint64_t get_be64(const unsigned char *p) { return (uint64_t)get_be32(p) << 32 | get_be32(p + 4); }
+
+static void put_le64(unsigned char *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_be64(unsigned char *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (unsigned char)(v >> (56 - 8 * i));
+}
+
+#define ROTL64(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND(v0, v1, v2, v3) do {                                  \
+        v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32);  \
+        v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;                       \
+        v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;                       \
+        v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32);  \
+    } while (0)
+
+/*
+ * SipHash-2-4, matching the kernel's siphash() for the same key words.
+ */
+static uint64_t siphash24(const unsigned char *in, size_t len, const uint64_t key[2])
+{
+    uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+    uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+    uint64_t b = (uint64_t)len << 56;
+    size_t i;
+
+    for (; len >= 8; in += 8, len -= 8) {
+        uint64_t m = get_le64(in);
+
+        v3 ^= m;
+        SIPROUND(v0, v1, v2, v3);
+        SIPROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    for (i = 0; i < len; i++)
+        b |= (uint64_t)in[i] << (8 * i);
+
+    v3 ^= b;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    v0 ^= b;
+    v2 ^= 0xff;
+    for (i = 0; i < 4; i++)
+        SIPROUND(v0, v1, v2, v3);
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/*
+ * Parse a heartbeat_key value: 32 hex digits, read as two little-endian words.
+ */
+static void parse_hb_key(const char *hex, uint64_t key[2])
+{
+    unsigned char raw[HB_KEY_LEN];
+    size_t i;
+
+    if (strlen(hex) != 2 * sizeof(raw))
+        die("key must be %zu hex digits", 2 * sizeof(raw));
+
+    for (i = 0; i < sizeof(raw); i++) {
+        unsigned int byte;
+
+        if (!isxdigit((unsigned char)hex[2 * i]) ||
+            !isxdigit((unsigned char)hex[2 * i + 1]) ||
+            sscanf(hex + 2 * i, "%2x", &byte) != 1)
+            die("invalid key: %s", hex);
+        raw[i] = (unsigned char)byte;
+    }
+
+    key[0] = get_le64(raw);
+    key[1] = get_le64(raw + 8);
+}
+
+/*
+ * Build an authenticated heartbeat: "W8HB" | be64 counter | le64 tag.
+ *
+ * The tag also covers the source and destination addresses the packet
+ * travels with (addrs), so the module rejects it if replayed from
+ * another station or to another host. The counter is the wall clock in
+ * nanoseconds, so it keeps increasing across sender restarts without
+ * any saved state.
+ */
+static void hb_build(unsigned char *msg, const uint64_t key[2], uint64_t *last,
+                     const unsigned char *addrs)
+{
+    unsigned char in[12 + HB_ADDRS_LEN];
+    struct timespec ts;
+    uint64_t ctr;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ctr = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    if (ctr <= *last)
+        ctr = *last + 1;
+    *last = ctr;
+
+    memcpy(in, HB_MAGIC, 4);
+    put_be64(in + 4, ctr);
+    memcpy(in + 12, addrs, HB_ADDRS_LEN);
+
+    memcpy(msg, in, 12);
+    put_le64(msg + 12, siphash24(in, sizeof(in), key));
+}
+
+/*
+ * One heartbeat destination and its send statistics.
+ */
+struct hb_target {
+    struct sockaddr_storage dst;
+    socklen_t dstlen;
+    uint64_t key[2];
+    int auth;
+    uint64_t last;                      /* last counter sent */
+    unsigned char addrs[HB_ADDRS_LEN];  /* covered by the tag, see hb_build */
+    unsigned char msg[HB_MSG_LEN];
+    uint64_t sent;
+    uint64_t errors;
+    int last_errno;
+};
+
+struct hb_targets {
+    struct hb_target *t;
+    size_t n;
+    size_t cap;
+};
+
+/*
+ * Resolve a numeric IPv4 or IPv6 address ("fe80::1%eth0" scopes allowed)
+ * and port into a socket address. Returns -1 if it is not an address.
+ */
+static int parse_sockaddr(const char *ip, int port, struct sockaddr_storage *ss,
+                          socklen_t *len)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_DGRAM,
+        .ai_flags = AI_NUMERICHOST | AI_NUMERICSERV,
+    };
+    struct addrinfo *ai;
+    char service[8];
+
+    snprintf(service, sizeof(service), "%d", port);
+    if (getaddrinfo(ip, service, &hints, &ai) != 0)
+        return -1;
+
+    memcpy(ss, ai->ai_addr, ai->ai_addrlen);
+    *len = ai->ai_addrlen;
+    freeaddrinfo(ai);
+    return 0;
+}
+
+/*
+ * Format a socket address as "addr" and return its port.
+ */
+static unsigned int format_sockaddr(const struct sockaddr_storage *ss, socklen_t len,
+                                    char *buf, size_t buflen)
+{
+    char service[8];
+
+    if (getnameinfo((const struct sockaddr *)ss, len, buf, (socklen_t)buflen,
+                    service, sizeof(service), NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        snprintf(buf, buflen, "?");
+        return 0;
+    }
+    return (unsigned int)atoi(service);
+}
+
+/*
+ * Store a socket address as 16 bytes, IPv4 as IPv4-mapped, as the
+ * module sees it.
+ */
+static void sockaddr_to_v6(const struct sockaddr_storage *ss, unsigned char *out)
+{
+    if (ss->ss_family == AF_INET6) {
+        memcpy(out, &((const struct sockaddr_in6 *)ss)->sin6_addr, 16);
+    } else {
+        memset(out, 0, 10);
+        out[10] = out[11] = 0xff;
+        memcpy(out + 12, &((const struct sockaddr_in *)ss)->sin_addr, 4);
+    }
+}
+
+/*
+ * Work out the addresses an authenticated heartbeat is bound to: the
+ * bind address if it is of the target's family, otherwise the source
+ * the kernel routes to the target from. NAT between the station and
+ * the host would change them and is not supported with a key.
+ */
+static void hb_target_addrs(struct hb_target *t, const struct sockaddr_storage *bind_src)
+{
+    struct sockaddr_storage src;
+    socklen_t len = sizeof(src);
+
+    if (bind_src && bind_src->ss_family == t->dst.ss_family) {
+        src = *bind_src;
+    } else {
+        int fd = socket(t->dst.ss_family, SOCK_DGRAM, 0);
+
+        if (fd < 0 || connect(fd, (const struct sockaddr *)&t->dst, t->dstlen) < 0 ||
+            getsockname(fd, (struct sockaddr *)&src, &len) < 0)
+            die("no route to heartbeat target: %s", strerror(errno));
+        close(fd);
+    }
+
+    sockaddr_to_v6(&src, t->addrs);
+    sockaddr_to_v6(&t->dst, t->addrs + 16);
+}
+
+static struct hb_target *hb_target_add(struct hb_targets *list, const char *ip, int port)
+{
+    struct hb_target *t;
+
+    if (list->n == list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 16;
+        list->t = realloc(list->t, list->cap * sizeof(*list->t));
+        if (!list->t)
+            die("out of memory");
+    }
+
+    t = &list->t[list->n++];
+    memset(t, 0, sizeof(*t));
+    if (parse_sockaddr(ip, port, &t->dst, &t->dstlen) < 0)
+        die("invalid IPv4 or IPv6 address: %s", ip);
+
+    return t;
+}
+
+/*
+ * Put IPv4 targets before IPv6 ones, keeping their order, so that each
+ * family is sent as one run of sendmmsg batches on its own socket.
+ */
+static void hb_targets_group(struct hb_targets *list)
+{
+    struct hb_target *sorted = malloc(list->n * sizeof(*sorted));
+    size_t i, n = 0;
+
+    if (!sorted)
+        die("out of memory");
+
+    for (i = 0; i < list->n; i++)
+        if (list->t[i].dst.ss_family == AF_INET)
+            sorted[n++] = list->t[i];
+    for (i = 0; i < list->n; i++)
+        if (list->t[i].dst.ss_family != AF_INET)
+            sorted[n++] = list->t[i];
+
+    free(list->t);
+    list->t = sorted;
+    list->cap = list->n;
+}
+
+/*
+ * Read a target list: one "IP PORT [KEY]" per line, '#' starts a comment.
+ * Targets without a key use the -k key, if any.
+ */
+static void hb_targets_load(struct hb_targets *list, const char *path)
+{
+    FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    char line[256];
+    int lineno = 0;
+
+    if (!f)
+        die("cannot open %s: %s", path, strerror(errno));
+
+    while (fgets(line, sizeof(line), f)) {
+        char ip[64], key[2 * HB_KEY_LEN + 2]; /* IPv6 plus a %scope */
+        char *hash = strchr(line, '#');
+        int port, fields;
+
+        lineno++;
+        if (hash)
+            *hash = '\0';
+
+        fields = sscanf(line, "%63s %d %33s", ip, &port, key);
+        if (fields <= 0)
+            continue;
+        if (fields < 2 || port < 1 || port > 65535)
+            die("%s:%d: expected \"IP PORT [KEY]\"", path, lineno);
+
+        struct hb_target *t = hb_target_add(list, ip, port);
+        if (fields == 3) {
+            parse_hb_key(key, t->key);
+            t->auth = 1;
+        }
+    }
+
+    if (f != stdin)
+        fclose(f);
+}
+
+/*
+ * Parse an interval in seconds, fractions allowed, into nanoseconds.
+ */
+static uint64_t parse_interval_ns(const char *s)
+{
+    char *end;
+    double sec;
+
+    errno = 0;
+    sec = strtod(s, &end);
+    if (errno != 0 || end == s || *end != '\0' || sec < 0 || sec > 86400)
+        die("invalid interval: %s", s);
+
+    if (sec > 0 && sec < 0.001)
+        die("interval must be at least 1 ms");
+
+    return (uint64_t)(sec * 1e9 + 0.5);
+}
+
+/*
+ * Send one heartbeat to every target with as few system calls as possible.
+ *
+ * Authenticated messages are rebuilt first so each carries a fresh
+ * counter. Targets are grouped by family (hb_targets_group), and each
+ * batch goes out on that family's socket. When sendmmsg stops at a
+ * failing datagram, that datagram is charged to its target and sending
+ * resumes after it.
+ */
+static void hb_send_round(const int fds[2], struct hb_targets *list, struct mmsghdr *mm)
+{
+    size_t i, off;
+
+    for (i = 0; i < list->n; i++) {
+        if (list->t[i].auth)
+            hb_build(list->t[i].msg, list->t[i].key, &list->t[i].last,
+                     list->t[i].addrs);
+    }
+
+    for (off = 0; off < list->n; ) {
+        int v6 = list->t[off].dst.ss_family == AF_INET6;
+        size_t want = 1;
+        int n;
+
+        while (off + want < list->n && want < HB_BATCH &&
+               (list->t[off + want].dst.ss_family == AF_INET6) == v6)
+            want++;
+
+        n = sendmmsg(fds[v6], mm + off, (unsigned int)want, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            list->t[off].errors++;
+            list->t[off].last_errno = errno;
+            off++;
+            continue;
+        }
+
+        for (i = off; i < off + (size_t)n; i++)
+            list->t[i].sent++;
+        off += (size_t)n;
+    }
+}
+
+static void hb_print_stats(const struct hb_targets *list, uint64_t rounds, uint64_t missed)
+{
+    uint64_t sent = 0, errors = 0;
+    char ip[NI_MAXHOST];
+    size_t i;
+
+    printf("%-15s %5s %12s %8s  %s\n", "target", "port", "sent", "errors", "last error");
+    for (i = 0; i < list->n; i++) {
+        const struct hb_target *t = &list->t[i];
+        unsigned int port = format_sockaddr(&t->dst, t->dstlen, ip, sizeof(ip));
+
+        sent += t->sent;
+        errors += t->errors;
+        printf("%-15s %5u %12" PRIu64 " %8" PRIu64 "  %s\n",
+               ip, port, t->sent, t->errors,
+               t->errors ? strerror(t->last_errno) : "-");
+    }
+
+    fprintf(stderr, "[+] %zu targets, %" PRIu64 " rounds, %" PRIu64 " sent, %"
+            PRIu64 " errors, %" PRIu64 " rounds missed\n",
+            list->n, rounds, sent, errors, missed);
+}
+
+static void heartbeat_usage(void)
+{
+    fprintf(stderr,
+        "usage: wrong8007ctl heartbeat <ip> <port> [options]\n"
+        "       wrong8007ctl heartbeat -f targets [options]\n"
+        "\n"
+        "  -i, --interval SEC  seconds between heartbeats, fractions allowed\n"
+        "                      (default: %d, 0 with -n sends back to back)\n"
+        "  -m, --message  MSG  payload to send (default: \"%s\")\n"
+        "  -k, --key      HEX  send authenticated heartbeats (module heartbeat_key)\n"
+        "  -f, --targets  FILE read \"IP PORT [KEY]\" lines ('-' for stdin)\n"
+        "  -n, --count    N    stop after N rounds\n"
+        "  -b, --bind     ADDR send from this local address\n"
+        "  -s, --stats         print per-target send statistics on exit\n"
+        "\n"
+        "Targets may be IPv4 or IPv6 addresses. Keeps the module's\n"
+        "heartbeat_host watchdog from timing out. Rounds\n"
+        "are scheduled on an absolute timer, so they do not drift, and each\n"
+        "round reaches every target through batched sendmmsg calls.\n"
+        "Ctrl-C to stop.\n",
+        DEFAULT_HB_INTERVAL, DEFAULT_HB_MESSAGE);
+}
+
 /*
  * Periodically transmit heartbeat packets.
  *
- * Keeps the kernel heartbeat monitor active.
+ * Keeps the kernel heartbeat monitor active on one or many hosts.
  */
 static int cmd_heartbeat(int argc, char **argv)
 {
+    struct hb_targets list = { 0 };
     const char *ip = NULL;
     const char *message = DEFAULT_HB_MESSAGE;
+    const char *keyhex = NULL;
+    const char *bind_ip = NULL;
+    const char *targets = NULL;
     int port = 0;
-    int interval = DEFAULT_HB_INTERVAL;
+    uint64_t interval = (uint64_t)DEFAULT_HB_INTERVAL * 1000000000ULL;
+    long count = 0;
+    int stats = 0;
+    size_t j;
     int i;
 
     /* Parse positional arguments followed by optional flags */
@@ -148,20 +595,26 @@ static int cmd_heartbeat(int argc, char **argv)
     for (i = 0; i < argc; i++) {
         if (!strcmp(argv[i], "-i") || !strcmp(argv[i], "--interval")) {
             if (++i >= argc) die("--interval requires a value");
-            interval = parse_int(argv[i], 1, INT_MAX);
+            interval = parse_interval_ns(argv[i]);
         } else if (!strcmp(argv[i], "-m") || !strcmp(argv[i], "--message")) {
             if (++i >= argc) die("--message requires a value");
             message = argv[i];
+        } else if (!strcmp(argv[i], "-k") || !strcmp(argv[i], "--key")) {
+            if (++i >= argc) die("--key requires a value");
+            keyhex = argv[i];
+        } else if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "--targets")) {
+            if (++i >= argc) die("--targets requires a value");
+            targets = argv[i];
+        } else if (!strcmp(argv[i], "-n") || !strcmp(argv[i], "--count")) {
+            if (++i >= argc) die("--count requires a value");
+            count = parse_int(argv[i], 1, INT_MAX);
+        } else if (!strcmp(argv[i], "-b") || !strcmp(argv[i], "--bind")) {
+            if (++i >= argc) die("--bind requires a value");
+            bind_ip = argv[i];
+        } else if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "--stats")) {
+            stats = 1;
         } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
-            fprintf(stderr,
-                "usage: wrong8007ctl heartbeat <ip> <port> [-i interval] [-m message]\n"
-                "\n"
-                "  -i, --interval SEC  seconds between heartbeats (default: %d)\n"
-                "  -m, --message  MSG  payload to send (default: \"%s\")\n"
-                "\n"
-                "Keeps the module's heartbeat_host watchdog from timing out.\n"
-                "Ctrl-C to stop.\n",
-                DEFAULT_HB_INTERVAL, DEFAULT_HB_MESSAGE);
+            heartbeat_usage();
             return 0;
         } else if (positional == 0) {
             ip = argv[i];
@@ -174,39 +627,160 @@ static int cmd_heartbeat(int argc, char **argv)
         }
     }
 
-    if (!ip || port == 0) {
-        fprintf(stderr,
-            "usage: wrong8007ctl heartbeat <ip> <port> [-i interval] [-m message]\n"
-            "\n"
-            "  -i, --interval SEC  seconds between heartbeats (default: %d)\n"
-            "  -m, --message  MSG  payload to send (default: \"%s\")\n"
-            "\n"
-            "Keeps the module's heartbeat_host watchdog from timing out.\n"
-            "Ctrl-C to stop.\n",
-            DEFAULT_HB_INTERVAL, DEFAULT_HB_MESSAGE);
+    if ((!ip || port == 0) && !targets) {
+        heartbeat_usage();
         return 1;
     }
 
-    struct sockaddr_in dst;
-    int fd = udp_open(ip, port, &dst);
+    /* Back-to-back sending is only for bounded runs such as benchmarks */
+    if (interval == 0 && !count)
+        die("--interval 0 requires --count");
+
+    if (ip)
+        hb_target_add(&list, ip, port);
+    if (targets)
+        hb_targets_load(&list, targets);
+    if (!list.n)
+        die("no heartbeat targets");
+    hb_targets_group(&list);
+
+    uint64_t key[2] = { 0, 0 };
+
+    if (keyhex) {
+        parse_hb_key(keyhex, key);
+        message = "<authenticated>";
+    }
+
+    /* Every datagram is described once; rounds only refresh the payloads */
+    struct mmsghdr *mm = calloc(list.n, sizeof(*mm));
+    struct iovec *iov = calloc(list.n, sizeof(*iov));
+    if (!mm || !iov)
+        die("out of memory");
+
+    for (j = 0; j < list.n; j++) {
+        struct hb_target *t = &list.t[j];
+
+        if (keyhex && !t->auth) {
+            memcpy(t->key, key, sizeof(key));
+            t->auth = 1;
+        }
+
+        iov[j].iov_base = t->auth ? (void *)t->msg : (void *)message;
+        iov[j].iov_len = t->auth ? sizeof(t->msg) : strlen(message);
+        mm[j].msg_hdr.msg_name = &t->dst;
+        mm[j].msg_hdr.msg_namelen = t->dstlen;
+        mm[j].msg_hdr.msg_iov = &iov[j];
+        mm[j].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* One socket per address family in use, indexed by "is IPv6" */
+    int fds[2] = { -1, -1 };
+
+    for (j = 0; j < list.n; j++) {
+        int v6 = list.t[j].dst.ss_family == AF_INET6;
+
+        if (fds[v6] < 0) {
+            fds[v6] = socket(v6 ? AF_INET6 : AF_INET, SOCK_DGRAM, 0);
+            if (fds[v6] < 0)
+                die("socket() failed: %s", strerror(errno));
+        }
+    }
+
+    /* Stations on a multi-homed box must be told apart by source address */
+    struct sockaddr_storage src;
+
+    if (bind_ip) {
+        socklen_t srclen;
+        int v6;
+
+        if (parse_sockaddr(bind_ip, 0, &src, &srclen) < 0)
+            die("invalid IPv4 or IPv6 address: %s", bind_ip);
+        v6 = src.ss_family == AF_INET6;
+        if (fds[v6] < 0)
+            die("--bind %s: no %s targets", bind_ip, v6 ? "IPv6" : "IPv4");
+        if (bind(fds[v6], (const struct sockaddr *)&src, srclen) < 0)
+            die("bind(%s) failed: %s", bind_ip, strerror(errno));
+    }
+
+    for (j = 0; j < list.n; j++) {
+        if (list.t[j].auth)
+            hb_target_addrs(&list.t[j], bind_ip ? &src : NULL);
+    }
+
+    /*
+     * A periodic absolute timer: each round is due at start + k * interval,
+     * however long the previous one took, so the schedule never drifts.
+     */
+    int tfd = -1;
+    if (interval) {
+        struct itimerspec its;
+        struct timespec now;
+
+        tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (tfd < 0)
+            die("timerfd_create() failed: %s", strerror(errno));
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        its.it_value = now;
+        its.it_interval.tv_sec = (time_t)(interval / 1000000000ULL);
+        its.it_interval.tv_nsec = (long)(interval % 1000000000ULL);
+        if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+            die("timerfd_settime() failed: %s", strerror(errno));
+    }
 
     install_signal_handlers();
 
-    fprintf(stderr, "[+] heartbeat -> %s:%d every %ds (message=\"%s\")\n", ip, port, interval, message);
+    if (list.n == 1) {
+        char dst[NI_MAXHOST];
+        unsigned int dport = format_sockaddr(&list.t[0].dst, list.t[0].dstlen,
+                                             dst, sizeof(dst));
+
+        fprintf(stderr, "[+] heartbeat -> %s port %u every %.3gs (message=\"%s\")\n",
+                dst, dport, interval / 1e9,
+                list.t[0].auth ? "<authenticated>" : message);
+    } else {
+        fprintf(stderr, "[+] heartbeat -> %zu targets every %.3gs\n", list.n, interval / 1e9);
+    }
     fprintf(stderr, "    Ctrl-C to stop.\n\n");
 
-    size_t msg_len = strlen(message);
-    while (!stop_requested) {
-        udp_send(fd, &dst, message, msg_len);
-        fprintf(stderr, "[>] sent heartbeat to %s:%d\n", ip, port);
+    uint64_t rounds = 0, missed = 0;
+    while (!stop_requested && (!count || rounds < (uint64_t)count)) {
+        if (tfd >= 0) {
+            uint64_t expirations;
+
+            if (read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                if (errno == EINTR)
+                    continue;
+                die("timerfd read failed: %s", strerror(errno));
+            }
 
-        /* Sleep in 1-second ticks so signals are handled promptly */
-        for (int slept = 0; slept < interval && !stop_requested; slept++)
-            sleep(1);
+            /* Rounds that could not be sent on time are skipped, not bunched */
+            missed += expirations - 1;
+        }
+
+        hb_send_round(fds, &list, mm);
+        rounds++;
+
+        if (list.n == 1 && interval >= 1000000000ULL)
+            fprintf(stderr, "[>] sent heartbeat\n");
     }
 
-    fprintf(stderr, "\n[!] heartbeat stopped. Kernel should detect timeout soon.\n");
-    close(fd);
+    if (count && rounds == (uint64_t)count)
+        fprintf(stderr, "[+] sent %" PRIu64 " rounds\n", rounds);
+    else
+        fprintf(stderr, "\n[!] heartbeat stopped. Kernel should detect timeout soon.\n");
+
+    if (stats || list.n > 1)
+        hb_print_stats(&list, rounds, missed);
+
+    if (tfd >= 0)
+        close(tfd);
+    for (j = 0; j < 2; j++)
+        if (fds[j] >= 0)
+            close(fds[j]);
+    free(mm);
+    free(iov);
+    free(list.t);
     return 0;
 }
 
@@ -319,8 +893,9 @@ static int cmd_usb_list(int argc, char **argv)
             fprintf(stderr,
                 "usage: wrong8007ctl usb-list [-v]\n"
                 "\n"
-                "  Lists removable USB block devices with VID:PID, for building\n"
-                "  USB_DEVICES rules (e.g. USB_DEVICES=\"1234:5678:insert\").\n"
+                "  Lists removable USB block devices with VID:PID and port path, for\n"
+                "  building USB_DEVICES rules (e.g. USB_DEVICES=\"1234:5678:insert\"\n"
+                "  or USB_DEVICES=\"path=1-3:1234:5678\").\n"
                 "\n"
                 "  -v, --verbose   also print manufacturer/product/serial when available\n");
             return 0;
@@ -376,7 +951,11 @@ static int cmd_usb_list(int argc, char **argv)
             read_sysfs_line(pid_path, pid, sizeof(pid)) != 0)
             continue;
 
-        printf("/dev/%-8s  VID:PID = %s:%s\n", ent->d_name, vid, pid);
+        /* The device directory is named after its port path, e.g. 1-3.2 */
+        const char *port_path = strrchr(usb_dir, '/');
+        port_path = port_path ? port_path + 1 : usb_dir;
+
+        printf("/dev/%-8s  VID:PID = %s:%s  path=%s\n", ent->d_name, vid, pid, port_path);
         found++;
 
         if (verbose) {
@@ -405,25 +984,1005 @@ static int cmd_usb_list(int argc, char **argv)
 }
 
 /*
- * Registered userspace commands.
+ * Write a single input event to the uinput device.
+ */
+static void uinput_emit(int fd, int type, int code, int value)
+{
+    struct input_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = (unsigned short)type;
+    ev.code = (unsigned short)code;
+    ev.value = value;
+
+    if (write(fd, &ev, sizeof(ev)) != (ssize_t)sizeof(ev))
+        die("uinput write failed: %s", strerror(errno));
+}
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L };
+
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+/*
+ * Inject raw keycodes through a virtual keyboard.
  *
- * Each command owns its argument parsing and description.
+ * The events enter the input core like those of a real keyboard, so they
+ * exercise the key_sequence / key_chord trigger without any hardware.
  */
-static const struct command commands[] = {
-    {
-        .name = "heartbeat",
-        .run = cmd_heartbeat,
-        .description = "Send periodic heartbeat packets",
-    },
-    {
-        .name = "send",
-        .run = cmd_send,
-        .description = "Send a trigger packet",
-    },
-    {
-        .name = "usb-list",
-        .run = cmd_usb_list,
-        .description = "List removable USB devices",
+static int cmd_keys(int argc, char **argv)
+{
+    int codes[MAX_KEYS];
+    int ncodes = 0;
+    int chord = 0;
+    int delay = DEFAULT_KEY_DELAY_MS;
+
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            fprintf(stderr,
+                "usage: wrong8007ctl keys [-c] [-d ms] <keycode> [keycode...]\n"
+                "\n"
+                "  Presses and releases each keycode in turn on a virtual uinput\n"
+                "  keyboard (keycodes as in linux/input-event-codes.h, e.g. 30 = KEY_A).\n"
+                "\n"
+                "  -c, --chord     press all keys down together, then release them\n"
+                "  -d, --delay ms  pause between events (default %d)\n",
+                DEFAULT_KEY_DELAY_MS);
+            return 0;
+        } else if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--chord")) {
+            chord = 1;
+        } else if (!strcmp(argv[i], "-d") || !strcmp(argv[i], "--delay")) {
+            if (++i >= argc)
+                die("missing value for %s", argv[i - 1]);
+            delay = parse_int(argv[i], 0, 10000);
+        } else {
+            if (ncodes == MAX_KEYS)
+                die("too many keycodes (max %d)", MAX_KEYS);
+            codes[ncodes++] = parse_int(argv[i], 1, KEY_MAX);
+        }
+    }
+
+    if (!ncodes)
+        die("no keycodes given (see 'keys --help')");
+
+    int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if (fd < 0)
+        die("cannot open /dev/uinput: %s", strerror(errno));
+
+    if (ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0)
+        die("UI_SET_EVBIT failed: %s", strerror(errno));
+    for (int i = 0; i < ncodes; i++) {
+        if (ioctl(fd, UI_SET_KEYBIT, codes[i]) < 0)
+            die("UI_SET_KEYBIT %d failed: %s", codes[i], strerror(errno));
+    }
+
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    setup.id.vendor = 0x8007;
+    setup.id.product = 0x0001;
+    snprintf(setup.name, sizeof(setup.name), "wrong8007ctl virtual keyboard");
+
+    if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0)
+        die("cannot create uinput device: %s", strerror(errno));
+
+    /* Input handlers connect synchronously; give userspace listeners a moment */
+    sleep_ms(200);
+
+    for (int i = 0; i < ncodes; i++) {
+        uinput_emit(fd, EV_KEY, codes[i], 1);
+        uinput_emit(fd, EV_SYN, SYN_REPORT, 0);
+        sleep_ms(delay);
+        if (!chord) {
+            uinput_emit(fd, EV_KEY, codes[i], 0);
+            uinput_emit(fd, EV_SYN, SYN_REPORT, 0);
+            sleep_ms(delay);
+        }
+    }
+
+    if (chord) {
+        for (int i = ncodes - 1; i >= 0; i--) {
+            uinput_emit(fd, EV_KEY, codes[i], 0);
+            uinput_emit(fd, EV_SYN, SYN_REPORT, 0);
+        }
+    }
+
+    fprintf(stderr, "[+] injected %d key%s%s\n", ncodes, ncodes == 1 ? "" : "s",
+            chord ? " as a chord" : "");
+
+    ioctl(fd, UI_DEV_DESTROY);
+    close(fd);
+    return 0;
+}
+
+/* How the bulk of a device is erased; each mode falls back to the next */
+enum wipe_mode {
+    WIPE_SECURE,    /* BLKSECDISCARD, then BLKZEROOUT */
+    WIPE_DISCARD,   /* BLKDISCARD, then BLKZEROOUT */
+    WIPE_ZERO,      /* BLKZEROOUT only */
+};
+
+static const char *const wipe_mode_names[] = {
+    [WIPE_SECURE] = "secure",
+    [WIPE_DISCARD] = "discard",
+    [WIPE_ZERO] = "zero",
+};
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/*
+ * Issue a range ioctl (BLKZEROOUT, BLKDISCARD, BLKSECDISCARD).
+ */
+static int blk_range(int fd, unsigned long req, uint64_t start, uint64_t len)
+{
+    uint64_t range[2] = { start, len };
+
+    return ioctl(fd, req, range);
+}
+
+/*
+ * Zero a range, with plain writes if the device cannot offload it.
+ */
+static int blk_zero(int fd, uint64_t start, uint64_t len)
+{
+    static const char zeros[1 << 16];
+
+    if (!len || blk_range(fd, BLKZEROOUT, start, len) == 0)
+        return 0;
+
+    if (errno != EOPNOTSUPP && errno != ENOTTY && errno != EINVAL)
+        return -1;
+
+    while (len) {
+        size_t n = len < sizeof(zeros) ? (size_t)len : sizeof(zeros);
+        ssize_t w = pwrite(fd, zeros, n, (off_t)start);
+
+        if (w <= 0)
+            return -1;
+        start += (uint64_t)w;
+        len -= (uint64_t)w;
+    }
+    return fdatasync(fd);
+}
+
+/*
+ * Header-first destruction plan.
+ *
+ * The planner reads the start of a device, recognises the structures
+ * that make its contents usable and lists their byte ranges by
+ * priority: LUKS key material first, then partition tables, then
+ * filesystem superblocks, then a generic head and tail. Destroying the
+ * first group alone makes an encrypted volume unrecoverable.
+ */
+#define WIPE_MAX_RANGES 64
+#define WIPE_PROBE_LEN (68 * 1024) /* Reaches the btrfs superblock at 64 KiB */
+#define WIPE_ALIGN 4096
+#define LUKS2_DEFAULT_SEGMENT (16 * MIB)
+
+enum wipe_prio {
+    PRIO_KEYS,      /* LUKS headers and keyslots */
+    PRIO_TABLE,     /* GPT, MBR */
+    PRIO_SUPER,     /* filesystem superblocks and metadata */
+    PRIO_GENERIC,   /* head and tail of the device */
+};
+
+struct wipe_range {
+    uint64_t start;
+    uint64_t len;
+    enum wipe_prio prio;
+    const char *what;
+};
+
+struct wipe_plan {
+    uint64_t size;
+    unsigned int sector;
+    int n;
+    struct wipe_range r[WIPE_MAX_RANGES];
+};
+
+/*
+ * Add a range, widened to WIPE_ALIGN so that it can be zeroed with
+ * BLKZEROOUT, and clipped to the device.
+ */
+static void plan_add(struct wipe_plan *plan, uint64_t start, uint64_t len,
+                     enum wipe_prio prio, const char *what)
+{
+    uint64_t end = start + len;
+
+    if (!len || start >= plan->size || end < start || plan->n == WIPE_MAX_RANGES)
+        return;
+
+    start -= start % WIPE_ALIGN;
+    end += (WIPE_ALIGN - end % WIPE_ALIGN) % WIPE_ALIGN;
+    if (end > plan->size)
+        end = plan->size;
+
+    plan->r[plan->n++] = (struct wipe_range){ start, end - start, prio, what };
+}
+
+/* Read up to len bytes at off; the rest of the buffer is zeroed */
+static void read_at(int fd, unsigned char *buf, size_t len, uint64_t off)
+{
+    ssize_t n = pread(fd, buf, len, (off_t)off);
+
+    if (n < 0)
+        n = 0;
+    memset(buf + n, 0, len - (size_t)n);
+}
+
+/*
+ * Find the data segment offset in a LUKS2 JSON area, which is where the
+ * keyslot area ends. Only the first "offset" of "segments" is needed.
+ */
+static uint64_t luks2_segment_offset(int fd, uint64_t base, uint64_t hdr_size)
+{
+    uint64_t off = LUKS2_DEFAULT_SEGMENT;
+    size_t len = hdr_size > 4096 + MIB ? MIB : (size_t)(hdr_size - 4096);
+    char *json = malloc(len + 1);
+
+    if (!json)
+        return off;
+
+    read_at(fd, (unsigned char *)json, len, base + 4096);
+    json[len] = '\0';
+
+    const char *seg = strstr(json, "\"segments\"");
+    const char *val = seg ? strstr(seg, "\"offset\"") : NULL;
+    if (val && (val = strchr(val + 8, '"')) != NULL) {
+        unsigned long long v = strtoull(val + 1, NULL, 10);
+        if (v >= 2 * hdr_size)
+            off = v;
+    }
+
+    free(json);
+    return off;
+}
+
+static void plan_probe(int fd, struct wipe_plan *plan, uint64_t base, uint64_t limit, int depth);
+
+static void plan_gpt(int fd, struct wipe_plan *plan, const unsigned char *hdr)
+{
+    uint64_t ss = plan->sector;
+    uint64_t entries = get_le64(hdr + 72) * ss;
+    uint64_t nent = get_le32(hdr + 80), esz = get_le32(hdr + 84);
+    uint64_t alt = get_le64(hdr + 32) * ss;
+    uint64_t ents = nent * esz;
+
+    plan_add(plan, 0, entries + ents, PRIO_TABLE, "gpt primary");
+    if (alt > ents)
+        plan_add(plan, alt - ents, ents + ss, PRIO_TABLE, "gpt backup");
+
+    if (esz < 128 || ents > WIPE_PROBE_LEN)
+        return;
+
+    unsigned char tab[WIPE_PROBE_LEN];
+    read_at(fd, tab, (size_t)ents, entries);
+
+    for (uint64_t i = 0; i < nent; i++) {
+        const unsigned char *e = tab + i * esz;
+        static const unsigned char unused[16];
+
+        if (!memcmp(e, unused, sizeof(unused)))
+            continue;
+
+        uint64_t first = get_le64(e + 32), last = get_le64(e + 40);
+        if (last >= first)
+            plan_probe(fd, plan, first * ss, (last - first + 1) * ss, 1);
+    }
+}
+
+#define MBR_MAX_LOGICAL 128 /* Bounds a corrupt or looping EBR chain */
+
+static int mbr_extended(uint8_t type)
+{
+    return type == 0x05 || type == 0x0f || type == 0x85;
+}
+
+/*
+ * Walk the chain of extended boot records in an extended partition.
+ * Each EBR describes one logical partition, relative to the EBR itself,
+ * and links to the next EBR, relative to the start of the extended
+ * partition. Links must move forward, so a loop ends the walk.
+ */
+static void plan_ebr(int fd, struct wipe_plan *plan, uint64_t ext, uint64_t ext_len)
+{
+    uint64_t ss = plan->sector;
+    uint64_t next = 0;
+
+    for (int i = 0; i < MBR_MAX_LOGICAL; i++) {
+        unsigned char ebr[512];
+        uint64_t at = ext + next;
+
+        read_at(fd, ebr, sizeof(ebr), at * ss);
+        if (ebr[510] != 0x55 || ebr[511] != 0xaa)
+            return;
+        plan_add(plan, at * ss, ss, PRIO_TABLE, "ebr");
+
+        const unsigned char *log = ebr + 446, *link = ebr + 446 + 16;
+        uint64_t lba = get_le32(log + 8), n = get_le32(log + 12);
+
+        if (log[4] && n && next + lba + n <= ext_len)
+            plan_probe(fd, plan, (at + lba) * ss, n * ss, 1);
+
+        uint64_t following = get_le32(link + 8);
+        if (!mbr_extended(link[4]) || following <= next || following >= ext_len)
+            return;
+        next = following;
+    }
+}
+
+/*
+ * MBR and EBR addresses count logical sectors, 4096 bytes on 4Kn disks.
+ */
+static void plan_mbr(int fd, struct wipe_plan *plan, const unsigned char *buf)
+{
+    uint64_t ss = plan->sector;
+
+    plan_add(plan, 0, ss, PRIO_TABLE, "mbr");
+
+    for (int i = 0; i < 4; i++) {
+        const unsigned char *e = buf + 446 + 16 * i;
+        uint8_t type = e[4];
+        uint64_t lba = get_le32(e + 8), n = get_le32(e + 12);
+
+        /* Skip empty and protective entries */
+        if (!type || type == 0xee || !n)
+            continue;
+        if (mbr_extended(type))
+            plan_ebr(fd, plan, lba, n);
+        else
+            plan_probe(fd, plan, lba * ss, n * ss, 1);
+    }
+}
+
+/*
+ * Probe a device or partition starting at base. Returns after the first
+ * recognised structure; partition tables are only looked for on the
+ * whole device.
+ */
+static void plan_probe(int fd, struct wipe_plan *plan, uint64_t base, uint64_t limit, int depth)
+{
+    unsigned char buf[WIPE_PROBE_LEN];
+
+    read_at(fd, buf, sizeof(buf), base);
+
+    if (!memcmp(buf, "LUKS\xba\xbe", 6)) {
+        if (get_be16(buf + 6) == 1) {
+            plan_add(plan, base, (uint64_t)get_be32(buf + 104) * 512, PRIO_KEYS, "luks1 header+keyslots");
+        } else {
+            uint64_t hdr = get_be64(buf + 8);
+            uint64_t seg = hdr > 4096 ? luks2_segment_offset(fd, base, hdr) : LUKS2_DEFAULT_SEGMENT;
+            plan_add(plan, base, seg, PRIO_KEYS, "luks2 headers+keyslots");
+        }
+        return; /* The rest is ciphertext */
+    }
+
+    if (get_le16(buf + 1024 + 56) == 0xef53) {
+        plan_add(plan, base, MIB < limit ? MIB : limit, PRIO_SUPER, "ext superblock+descriptors");
+        return;
+    }
+
+    if (!memcmp(buf, "XFSB", 4)) {
+        plan_add(plan, base, 64 * 1024, PRIO_SUPER, "xfs superblock");
+        return;
+    }
+
+    if (!memcmp(buf + 65536 + 64, "_BHRfS_M", 8)) {
+        static const uint64_t mirrors[] = { 64 * 1024, 64 * MIB, 256 * 1024 * MIB };
+
+        for (size_t i = 0; i < ARRAY_SIZE(mirrors); i++) {
+            if (mirrors[i] < limit)
+                plan_add(plan, base + mirrors[i], 4096, PRIO_SUPER, "btrfs superblock");
+        }
+        return;
+    }
+
+    if (!memcmp(buf + 3, "NTFS    ", 8)) {
+        uint64_t cluster = (uint64_t)get_le16(buf + 11) * buf[13];
+
+        plan_add(plan, base, 8192, PRIO_SUPER, "ntfs boot");
+        plan_add(plan, base + get_le64(buf + 48) * cluster, MIB, PRIO_SUPER, "ntfs mft");
+        plan_add(plan, base + limit - 512, 512, PRIO_SUPER, "ntfs backup boot");
+        return;
+    }
+
+    if (!memcmp(buf + 82, "FAT32   ", 8) || !memcmp(buf + 54, "FAT1", 4)) {
+        uint64_t fatsz = get_le16(buf + 22) ? get_le16(buf + 22) : get_le32(buf + 36);
+        uint64_t sectors = get_le16(buf + 14) + buf[16] * fatsz;
+
+        plan_add(plan, base, sectors * get_le16(buf + 11), PRIO_SUPER, "fat reserved+tables");
+        return;
+    }
+
+    if (depth)
+        return;
+
+    if (!memcmp(buf + plan->sector, "EFI PART", 8)) {
+        plan_gpt(fd, plan, buf + plan->sector);
+        return;
+    }
+
+    if (buf[510] == 0x55 && buf[511] == 0xaa)
+        plan_mbr(fd, plan, buf);
+}
+
+static int range_cmp(const void *a, const void *b)
+{
+    const struct wipe_range *x = a, *y = b;
+
+    if (x->prio != y->prio)
+        return (int)x->prio - (int)y->prio;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+/*
+ * Build the plan for an open device.
+ */
+static int plan_build(int fd, struct wipe_plan *plan, uint64_t head)
+{
+    int ss;
+
+    memset(plan, 0, sizeof(*plan));
+    if (ioctl(fd, BLKGETSIZE64, &plan->size) < 0)
+        return -1;
+    plan->sector = ioctl(fd, BLKSSZGET, &ss) == 0 && ss >= 512 ? (unsigned int)ss : 512;
+
+    plan_probe(fd, plan, 0, plan->size, 0);
+
+    /* Whatever was not recognised: the head and tail of the device */
+    if (head) {
+        plan_add(plan, 0, head, PRIO_GENERIC, "head");
+        if (plan->size > head)
+            plan_add(plan, plan->size - head, head, PRIO_GENERIC, "tail");
+    }
+
+    qsort(plan->r, (size_t)plan->n, sizeof(plan->r[0]), range_cmp);
+    return 0;
+}
+
+static void plan_print(const char *dev, const struct wipe_plan *plan)
+{
+    printf("%s (%" PRIu64 " MiB)\n", dev, plan->size / MIB);
+    for (int i = 0; i < plan->n; i++)
+        printf("  %-26s %12" PRIu64 " +%" PRIu64 "\n",
+               plan->r[i].what, plan->r[i].start, plan->r[i].len);
+}
+
+/*
+ * Phase 1 for one device: plan and zero the critical ranges.
+ */
+static int wipe_headers(const char *dev, uint64_t head)
+{
+    struct wipe_plan plan;
+    uint64_t bytes = 0;
+
+    int fd = open(dev, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "[!] %s: open: %s\n", dev, strerror(errno));
+        return 1;
+    }
+
+    double t0 = now_ms();
+    if (plan_build(fd, &plan, head) < 0) {
+        fprintf(stderr, "[!] %s: not a block device: %s\n", dev, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    double t1 = now_ms();
+
+    for (int i = 0; i < plan.n; i++) {
+        if (blk_zero(fd, plan.r[i].start, plan.r[i].len) < 0) {
+            fprintf(stderr, "[!] %s: %s: %s\n", dev, plan.r[i].what, strerror(errno));
+            close(fd);
+            return 1;
+        }
+        bytes += plan.r[i].len;
+    }
+    double t2 = now_ms();
+    close(fd);
+
+    fprintf(stderr, "[+] %s: plan %.1f ms, %d ranges (%" PRIu64 " KiB) %.1f ms\n",
+            dev, t1 - t0, plan.n, bytes / 1024, t2 - t1);
+    return 0;
+}
+
+/*
+ * Phase 2 for one device: erase everything with the fastest method the
+ * device supports.
+ */
+static int wipe_bulk(const char *dev, enum wipe_mode mode)
+{
+    uint64_t size;
+
+    int fd = open(dev, O_WRONLY);
+    if (fd < 0 || ioctl(fd, BLKGETSIZE64, &size) < 0) {
+        fprintf(stderr, "[!] %s: %s\n", dev, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+
+    double t0 = now_ms();
+    const char *method = "zero";
+    int ret = -1;
+
+    if (mode == WIPE_SECURE) {
+        ret = blk_range(fd, BLKSECDISCARD, 0, size);
+        method = "secure-discard";
+    } else if (mode == WIPE_DISCARD) {
+        ret = blk_range(fd, BLKDISCARD, 0, size);
+        method = "discard";
+    }
+    if (ret < 0) {
+        method = "zero";
+        ret = blk_zero(fd, 0, size);
+    }
+    double t1 = now_ms();
+    close(fd);
+
+    if (ret < 0) {
+        fprintf(stderr, "[!] %s: bulk wipe failed: %s\n", dev, strerror(errno));
+        return 1;
+    }
+
+    fprintf(stderr, "[+] %s: %" PRIu64 " MiB, bulk (%s) %.1f ms\n",
+            dev, size / MIB, method, t1 - t0);
+    return 0;
+}
+
+/*
+ * Whole disks worth wiping: skips virtual devices, optical drives and
+ * read-only or empty devices.
+ */
+static int wipe_list_disks(char (*devs)[WIPE_DEV_LEN], int max)
+{
+    static const char *const skip[] = { "loop", "ram", "zram", "dm-", "md", "sr", "fd", "nbd" };
+    int n = 0;
+
+    DIR *d = opendir("/sys/block");
+    if (!d)
+        die("cannot open /sys/block: %s", strerror(errno));
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL && n < max) {
+        if (ent->d_name[0] == '.')
+            continue;
+
+        size_t i;
+        for (i = 0; i < ARRAY_SIZE(skip); i++) {
+            if (!strncmp(ent->d_name, skip[i], strlen(skip[i])))
+                break;
+        }
+        if (i < ARRAY_SIZE(skip))
+            continue;
+
+        char path[SYSFS_PATH_MAX], val[32];
+        snprintf(path, sizeof(path), "/sys/block/%s/ro", ent->d_name);
+        if (read_sysfs_line(path, val, sizeof(val)) != 0 || strcmp(val, "0") != 0)
+            continue;
+        snprintf(path, sizeof(path), "/sys/block/%s/size", ent->d_name);
+        if (read_sysfs_line(path, val, sizeof(val)) != 0 || !strcmp(val, "0"))
+            continue;
+
+        snprintf(devs[n++], sizeof(devs[0]), "/dev/%s", ent->d_name);
+    }
+    closedir(d);
+
+    return n;
+}
+
+/*
+ * Run one phase on every device at once, one process per device.
+ * Returns the number of devices that failed.
+ */
+static int wipe_phase(char (*devs)[WIPE_DEV_LEN], int ndevs, int bulk,
+                      enum wipe_mode mode, uint64_t head)
+{
+    pid_t pids[MAX_WIPE_DEVICES];
+    int failed = 0;
+
+    for (int i = 0; i < ndevs; i++) {
+        pids[i] = fork();
+        if (pids[i] < 0)
+            die("fork: %s", strerror(errno));
+        if (pids[i] == 0)
+            _exit(bulk ? wipe_bulk(devs[i], mode) : wipe_headers(devs[i], head));
+    }
+
+    for (int i = 0; i < ndevs; i++) {
+        int status;
+
+        if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+            failed++;
+    }
+
+    return failed;
+}
+
+/*
+ * Erase block devices in parallel.
+ *
+ * A native replacement for shell wipe payloads: no helper binaries, one
+ * process per device, and the ranges that make a device unusable are
+ * destroyed on every device before any bulk erase starts.
+ */
+static int cmd_wipe(int argc, char **argv)
+{
+    char devs[MAX_WIPE_DEVICES][WIPE_DEV_LEN];
+    int ndevs = 0, all = 0, yes = 0, headers_only = 0;
+    enum wipe_mode mode = WIPE_SECURE;
+    int head_mib = DEFAULT_WIPE_HEAD_MIB;
+
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            fprintf(stderr,
+                "usage: wrong8007ctl wipe [-a | <device>...] [-m mode] [-H MiB] [-o] [-y]\n"
+                "\n"
+                "  Erases block devices in parallel, one process per device, in two\n"
+                "  phases. First, on every device, the ranges that make it usable:\n"
+                "  LUKS headers and keyslots, GPT/MBR tables, filesystem superblocks\n"
+                "  (also inside partitions), and the device's head and tail. Then the\n"
+                "  whole of every device. Without --yes, prints the plan.\n"
+                "\n"
+                "  -a, --all           every writable disk (skips loop, ram, dm, md, optical)\n"
+                "  -m, --mode mode     bulk method: secure (default), discard or zero;\n"
+                "                      falls back to zeroing when unsupported\n"
+                "  -H, --head MiB      generic head and tail size (default %d)\n"
+                "  -o, --headers-only  stop after the first phase (enough for LUKS)\n"
+                "  -y, --yes           actually erase\n",
+                DEFAULT_WIPE_HEAD_MIB);
+            return 0;
+        } else if (!strcmp(argv[i], "-a") || !strcmp(argv[i], "--all")) {
+            all = 1;
+        } else if (!strcmp(argv[i], "-y") || !strcmp(argv[i], "--yes")) {
+            yes = 1;
+        } else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--headers-only")) {
+            headers_only = 1;
+        } else if (!strcmp(argv[i], "-m") || !strcmp(argv[i], "--mode")) {
+            if (++i >= argc)
+                die("missing value for %s", argv[i - 1]);
+            size_t m;
+            for (m = 0; m < ARRAY_SIZE(wipe_mode_names); m++) {
+                if (!strcmp(argv[i], wipe_mode_names[m]))
+                    break;
+            }
+            if (m == ARRAY_SIZE(wipe_mode_names))
+                die("unknown wipe mode: %s", argv[i]);
+            mode = (enum wipe_mode)m;
+        } else if (!strcmp(argv[i], "-H") || !strcmp(argv[i], "--head")) {
+            if (++i >= argc)
+                die("missing value for %s", argv[i - 1]);
+            head_mib = parse_int(argv[i], 0, 1024);
+        } else {
+            if (ndevs == MAX_WIPE_DEVICES)
+                die("too many devices (max %d)", MAX_WIPE_DEVICES);
+            snprintf(devs[ndevs++], sizeof(devs[0]), "%s", argv[i]);
+        }
+    }
+
+    if (all)
+        ndevs += wipe_list_disks(devs + ndevs, MAX_WIPE_DEVICES - ndevs);
+
+    if (!ndevs)
+        die("no devices given (see 'wipe --help')");
+
+    uint64_t head = (uint64_t)head_mib * MIB;
+
+    if (!yes) {
+        fprintf(stderr, "[*] plan (mode %s%s); pass --yes to proceed:\n",
+                wipe_mode_names[mode], headers_only ? ", headers only" : "");
+        for (int i = 0; i < ndevs; i++) {
+            struct wipe_plan plan;
+            int fd = open(devs[i], O_RDONLY);
+
+            if (fd < 0 || plan_build(fd, &plan, head) < 0)
+                fprintf(stderr, "[!] %s: %s\n", devs[i], strerror(errno));
+            else
+                plan_print(devs[i], &plan);
+            if (fd >= 0)
+                close(fd);
+        }
+        return 0;
+    }
+
+    double t0 = now_ms();
+    int failed = wipe_phase(devs, ndevs, 0, mode, head);
+    double t1 = now_ms();
+
+    fprintf(stderr, "[%c] phase 1 (headers): %d of %d device%s in %.1f ms\n",
+            failed ? '!' : '+', ndevs - failed, ndevs, ndevs == 1 ? "" : "s", t1 - t0);
+
+    if (!headers_only) {
+        int bulk_failed = wipe_phase(devs, ndevs, 1, mode, head);
+
+        fprintf(stderr, "[%c] phase 2 (bulk): %d of %d device%s in %.1f ms\n",
+                bulk_failed ? '!' : '+', ndevs - bulk_failed, ndevs,
+                ndevs == 1 ? "" : "s", now_ms() - t1);
+        failed += bulk_failed;
+    }
+
+    fprintf(stderr, "[*] total %.1f ms\n", now_ms() - t0);
+    return failed ? 1 : 0;
+}
+
+/*
+ * Trigger events read from /dev/wrong8007.
+ *
+ * Mirrors struct wb_event and enum wb_event_type in include/events.h;
+ * keep them in sync. Records are in host byte order.
+ */
+#define EVENT_DEV "/dev/wrong8007"
+#define EVENT_PACKETS_PARAM "/sys/module/wrong8007/parameters/event_packets"
+#define EVENT_TAG_LEN 16
+#define EVENT_NO_SOURCE 0xff
+#define EVENT_BATCH 1365 /* records per read, just under 64 KiB */
+
+struct mon_event {
+    uint64_t ts_ns;
+    uint16_t type;
+    uint8_t source;
+    uint8_t pad;
+    uint32_t cpu;
+    uint64_t arg[2];
+    uint8_t tag[EVENT_TAG_LEN];
+};
+
+_Static_assert(sizeof(struct mon_event) == 48, "struct mon_event must match struct wb_event");
+
+enum {
+    EV_LOST,
+    EV_MATCH,
+    EV_ACTIVATE,
+    EV_PARTIAL,
+    EV_TIMING,
+    EV_HB_GAP,
+    EV_CONFIG,
+    EV_PACKET,
+};
+
+static const char *const event_names[] = {
+    [EV_LOST]     = "lost",
+    [EV_MATCH]    = "match",
+    [EV_ACTIVATE] = "activate",
+    [EV_PARTIAL]  = "partial",
+    [EV_TIMING]   = "timing",
+    [EV_HB_GAP]   = "hb_gap",
+    [EV_CONFIG]   = "config",
+    [EV_PACKET]   = "packet",
+};
+
+static const char *const source_names[] = {
+    "keyboard", "usb", "network", "heartbeat", "input",
+};
+
+static const char *event_name(unsigned int type)
+{
+    return type < ARRAY_SIZE(event_names) ? event_names[type] : "unknown";
+}
+
+static const char *event_source(unsigned int src)
+{
+    if (src == EVENT_NO_SOURCE)
+        return "-";
+    return src < ARRAY_SIZE(source_names) ? source_names[src] : "unknown";
+}
+
+/*
+ * Format an address tag; IPv4 is carried IPv4-mapped.
+ */
+static const char *event_addr(const uint8_t *tag, char *buf, size_t len)
+{
+    static const uint8_t mapped[12] = { [10] = 0xff, [11] = 0xff };
+
+    if (!memcmp(tag, mapped, sizeof(mapped)))
+        return inet_ntop(AF_INET, tag + 12, buf, len);
+    return inet_ntop(AF_INET6, tag, buf, len);
+}
+
+static void event_print(const struct mon_event *e, int json)
+{
+    char addr[INET6_ADDRSTRLEN];
+    int nlen = (int)strnlen((const char *)e->tag, EVENT_TAG_LEN);
+
+    if (json)
+        printf("{\"ts_ns\":%" PRIu64 ",\"cpu\":%" PRIu32 ",\"type\":\"%s\",\"source\":\"%s\"",
+               e->ts_ns, e->cpu, event_name(e->type), event_source(e->source));
+    else
+        printf("%" PRIu64 ".%06" PRIu64 " cpu%-3" PRIu32 " %-8s %-9s",
+               e->ts_ns / 1000000000, e->ts_ns / 1000 % 1000000, e->cpu,
+               event_name(e->type), event_source(e->source));
+
+    switch (e->type) {
+    case EV_LOST:
+        printf(json ? ",\"dropped\":%" PRIu64 : " dropped=%" PRIu64, e->arg[0]);
+        break;
+    case EV_PARTIAL:
+        printf(json ? ",\"progress\":%" PRIu64 : " progress=%" PRIu64, e->arg[0]);
+        break;
+    case EV_TIMING:
+        printf(json ? ",\"phrase\":%" PRIu64 : " phrase=%" PRIu64, e->arg[0]);
+        break;
+    case EV_HB_GAP:
+        event_addr(e->tag, addr, sizeof(addr));
+        if (json)
+            printf(",\"host\":\"%s\",\"gap_ms\":%" PRIu64 ",\"threshold_ms\":%" PRIu64,
+                   addr, e->arg[0], e->arg[1]);
+        else
+            printf(" host=%s gap=%" PRIu64 "ms threshold=%" PRIu64 "ms",
+                   addr, e->arg[0], e->arg[1]);
+        break;
+    case EV_CONFIG:
+        /* Parameter names are plain identifiers; no escaping needed */
+        printf(json ? ",\"param\":\"%.*s\"" : " param=%.*s", nlen, (const char *)e->tag);
+        break;
+    case EV_PACKET:
+        event_addr(e->tag, addr, sizeof(addr));
+        if (json)
+            printf(",\"saddr\":\"%s\",\"len\":%" PRIu64 ",\"proto\":%" PRIu64,
+                   addr, e->arg[0], e->arg[1]);
+        else
+            printf(" saddr=%s len=%" PRIu64 " proto=%" PRIu64, addr, e->arg[0], e->arg[1]);
+        break;
+    }
+
+    fputs(json ? "}\n" : "\n", stdout);
+}
+
+/*
+ * Write a module parameter, returning the previous value in old.
+ */
+static int param_swap(const char *path, const char *val, char *old, size_t oldlen)
+{
+    FILE *f;
+
+    if (old && read_sysfs_line(path, old, oldlen) < 0)
+        return -1;
+
+    f = fopen(path, "w");
+    if (!f)
+        return -1;
+    fputs(val, f);
+    return fclose(f);
+}
+
+/*
+ * Stream trigger events from the kernel module.
+ *
+ * The device keeps a ring per CPU and is drained with poll() and large
+ * reads, so a per-packet event stream under a flood costs one syscall
+ * per batch of records. Dropped records are reported as "lost" events.
+ */
+static int cmd_monitor(int argc, char **argv)
+{
+    static struct mon_event buf[EVENT_BATCH];
+    uint64_t events = 0, lost = 0, limit = 0;
+    int json = 0, packets = 0;
+    char old_packets[16] = "";
+
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            fprintf(stderr,
+                "usage: wrong8007ctl monitor [-j] [-p] [-n count]\n"
+                "\n"
+                "  Prints trigger events from " EVENT_DEV " as they happen:\n"
+                "  matches, activations, near-misses (abandoned or mistimed\n"
+                "  phrases, heartbeat gaps) and runtime parameter changes.\n"
+                "\n"
+                "  -j, --json     one JSON object per line\n"
+                "  -p, --packets  also report every inspected packet (debug)\n"
+                "  -n, --count N  exit after N events\n");
+            return 0;
+        } else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--json")) {
+            json = 1;
+        } else if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "--packets")) {
+            packets = 1;
+        } else if (!strcmp(argv[i], "-n") || !strcmp(argv[i], "--count")) {
+            if (++i >= argc)
+                die("missing value for %s", argv[i - 1]);
+            limit = (uint64_t)parse_int(argv[i], 1, INT_MAX);
+        } else {
+            die("unknown option: %s", argv[i]);
+        }
+    }
+
+    int fd = open(EVENT_DEV, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        die("open(%s): %s%s", EVENT_DEV, strerror(errno),
+            errno == EBUSY ? " (another monitor is running)" : "");
+
+    if (packets && param_swap(EVENT_PACKETS_PARAM, "1", old_packets, sizeof(old_packets)) < 0)
+        die("%s: %s", EVENT_PACKETS_PARAM, strerror(errno));
+
+    install_signal_handlers();
+    fprintf(stderr, "[*] monitoring %s%s\n", EVENT_DEV, packets ? " with packet events" : "");
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    while (!stop_requested && (!limit || events < limit)) {
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            die("poll: %s", strerror(errno));
+        }
+
+        /* Drain everything that is ready before sleeping again */
+        for (;;) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EINTR)
+                    break;
+                die("read(%s): %s", EVENT_DEV, strerror(errno));
+            }
+
+            for (size_t i = 0; i < (size_t)n / sizeof(buf[0]); i++) {
+                if (buf[i].type == EV_LOST)
+                    lost += buf[i].arg[0];
+                else if (limit && events == limit)
+                    break;
+                else
+                    events++;
+                event_print(&buf[i], json);
+            }
+
+            if ((size_t)n < sizeof(buf) || (limit && events == limit))
+                break;
+        }
+        fflush(stdout);
+    }
+
+    if (packets)
+        param_swap(EVENT_PACKETS_PARAM, old_packets, NULL, 0);
+    close(fd);
+
+    fprintf(stderr, "[+] %" PRIu64 " events, %" PRIu64 " lost\n", events, lost);
+    return 0;
+}
+
+/*
+ * Registered userspace commands.
+ *
+ * Each command owns its argument parsing and description.
+ */
+static const struct command commands[] = {
+    {
+        .name = "heartbeat",
+        .run = cmd_heartbeat,
+        .description = "Send periodic heartbeat packets",
+    },
+    {
+        .name = "send",
+        .run = cmd_send,
+        .description = "Send a trigger packet",
+    },
+    {
+        .name = "usb-list",
+        .run = cmd_usb_list,
+        .description = "List removable USB devices",
+    },
+    {
+        .name = "keys",
+        .run = cmd_keys,
+        .description = "Inject raw keycodes via uinput",
+    },
+    {
+        .name = "wipe",
+        .run = cmd_wipe,
+        .description = "Erase block devices in parallel",
+    },
+    {
+        .name = "monitor",
+        .run = cmd_monitor,
+        .description = "Stream trigger events",
     },
 };
 
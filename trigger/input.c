@@ -0,0 +1,318 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: raw keycode trigger
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#include <linux/input.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/bitmap.h>
+
+#include <wrong8007.h>
+#include <stats.h>
+
+#define MAX_KEY_SEQUENCE 32
+#define MAX_KEY_CHORD 8
+
+static char *key_sequence;
+module_param(key_sequence, charp, 0000);
+MODULE_PARM_DESC(key_sequence, "keycodes to press in order, comma-separated (e.g., '35,23,38,38,24')");
+
+static char *key_chord;
+module_param(key_chord, charp, 0000);
+MODULE_PARM_DESC(key_chord, "keycodes to hold down together, '+'-separated (e.g., '29+56+111')");
+
+/*
+ * Parsed configuration. Both conditions are tested against EV_KEY codes
+ * straight from the input core, before any keymap or VT processing, so
+ * they also see keyboards held in raw mode by X or a Wayland compositor.
+ */
+static u16 seq[MAX_KEY_SEQUENCE];
+static u8 seq_fail[MAX_KEY_SEQUENCE];   /* KMP failure function */
+static unsigned int seq_len;
+static DECLARE_BITMAP(seq_keys, KEY_CNT);
+
+static DECLARE_BITMAP(chord_keys, KEY_CNT);
+static unsigned int chord_len;
+
+/*
+ * Per-device match state. Events of one device are delivered under its
+ * event_lock, so the state needs no locking of its own.
+ */
+struct key_handle {
+    struct input_handle handle;
+    unsigned int seq_pos;
+    unsigned int chord_held;
+    DECLARE_BITMAP(down, KEY_CNT);
+};
+
+static bool input_registered;
+
+static void key_fire(const char *what)
+{
+    wb_count_inc(WB_CNT_INPUT_HIT);
+    wb_info("key %s matched, scheduling exec\n", what);
+    wrong8007_activate(WB_SRC_INPUT, ktime_get());
+}
+
+/*
+ * Advance the sequence matcher by one key press. Keys that are not part
+ * of the sequence reset it after a single bitmap test; the failure
+ * function keeps overlapping prefixes ("1,1,2" typed as "1,1,1,2").
+ */
+static void key_sequence_step(struct key_handle *kh, unsigned int code)
+{
+    unsigned int pos = kh->seq_pos;
+
+    if (!test_bit(code, seq_keys)) {
+        kh->seq_pos = 0;
+        return;
+    }
+
+    while (pos && seq[pos] != code)
+        pos = seq_fail[pos - 1];
+    if (seq[pos] == code)
+        pos++;
+
+    if (pos == seq_len) {
+        key_fire("sequence");
+        pos = 0;
+    }
+    kh->seq_pos = pos;
+}
+
+static void key_chord_step(struct key_handle *kh, unsigned int code, int value)
+{
+    if (!test_bit(code, chord_keys))
+        return;
+
+    if (value) {
+        if (__test_and_set_bit(code, kh->down))
+            return;
+        if (++kh->chord_held == chord_len)
+            key_fire("chord");
+    } else if (__test_and_clear_bit(code, kh->down)) {
+        kh->chord_held--;
+    }
+}
+
+static void key_event(struct input_handle *handle, unsigned int type,
+                      unsigned int code, int value)
+{
+    struct key_handle *kh = container_of(handle, struct key_handle, handle);
+
+    // Only presses and releases; autorepeat (value 2) is ignored
+    if (type != EV_KEY || code >= KEY_CNT || value == 2)
+        return;
+
+    wb_count_inc(WB_CNT_INPUT_EVENTS);
+
+    if (chord_len)
+        key_chord_step(kh, code, value);
+    if (seq_len && value == 1)
+        key_sequence_step(kh, code);
+}
+
+static int key_connect(struct input_handler *handler, struct input_dev *dev,
+                       const struct input_device_id *id)
+{
+    struct key_handle *kh;
+    int ret;
+
+    kh = kzalloc(sizeof(*kh), GFP_KERNEL);
+    if (!kh)
+        return -ENOMEM;
+
+    kh->handle.dev = dev;
+    kh->handle.handler = handler;
+    kh->handle.name = "wrong8007";
+
+    ret = input_register_handle(&kh->handle);
+    if (ret)
+        goto err_free;
+
+    ret = input_open_device(&kh->handle);
+    if (ret)
+        goto err_unregister;
+
+    wb_dbg("input: attached to %s\n", dev_name(&dev->dev));
+    return 0;
+
+err_unregister:
+    input_unregister_handle(&kh->handle);
+err_free:
+    kfree(kh);
+    return ret;
+}
+
+static void key_disconnect(struct input_handle *handle)
+{
+    struct key_handle *kh = container_of(handle, struct key_handle, handle);
+
+    input_close_device(handle);
+    input_unregister_handle(handle);
+    kfree(kh);
+}
+
+// Any device that can report keys
+static const struct input_device_id key_ids[] = {
+    {
+        .flags = INPUT_DEVICE_ID_MATCH_EVBIT,
+        .evbit = { BIT_MASK(EV_KEY) },
+    },
+    { },
+};
+
+static struct input_handler key_handler = {
+    .event = key_event,
+    .connect = key_connect,
+    .disconnect = key_disconnect,
+    .name = "wrong8007",
+    .id_table = key_ids,
+};
+
+/*
+ * Parse a list of keycodes separated by sep into codes[], up to max.
+ */
+static int parse_keycodes(const char *spec, const char *sep, u16 *codes,
+                          unsigned int max, unsigned int *count)
+{
+    char *buf, *cur, *entry;
+    int ret = 0;
+
+    *count = 0;
+
+    buf = kstrdup(spec, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    cur = buf;
+    while ((entry = strsep(&cur, sep)) != NULL) {
+        u16 code;
+
+        if (!*entry)
+            continue;
+
+        if (*count == max || kstrtou16(entry, 0, &code) || !code ||
+            code >= KEY_CNT) {
+            ret = -EINVAL;
+            break;
+        }
+        codes[(*count)++] = code;
+    }
+
+    kfree(buf);
+    return ret;
+}
+
+static int parse_sequence(void)
+{
+    unsigned int i, k;
+    int ret;
+
+    ret = parse_keycodes(key_sequence, ",", seq, MAX_KEY_SEQUENCE, &seq_len);
+    if (ret || !seq_len) {
+        wb_err("invalid key_sequence '%s' (1 to %d keycodes)\n",
+               key_sequence, MAX_KEY_SEQUENCE);
+        seq_len = 0;
+        return -EINVAL;
+    }
+
+    bitmap_zero(seq_keys, KEY_CNT);
+    for (i = 0; i < seq_len; i++)
+        set_bit(seq[i], seq_keys);
+
+    // Standard KMP prefix function
+    seq_fail[0] = 0;
+    for (i = 1, k = 0; i < seq_len; i++) {
+        while (k && seq[i] != seq[k])
+            k = seq_fail[k - 1];
+        if (seq[i] == seq[k])
+            k++;
+        seq_fail[i] = k;
+    }
+
+    return 0;
+}
+
+static int parse_chord(void)
+{
+    u16 codes[MAX_KEY_CHORD];
+    unsigned int i, n;
+    int ret;
+
+    ret = parse_keycodes(key_chord, "+", codes, MAX_KEY_CHORD, &n);
+    if (ret)
+        goto invalid;
+
+    bitmap_zero(chord_keys, KEY_CNT);
+    for (i = 0; i < n; i++)
+        set_bit(codes[i], chord_keys);
+
+    // Duplicates collapse, so count distinct keys: '29+29' is one key
+    if (bitmap_weight(chord_keys, KEY_CNT) < 2)
+        goto invalid;
+
+    chord_len = bitmap_weight(chord_keys, KEY_CNT);
+    return 0;
+
+invalid:
+    wb_err("invalid key_chord '%s' (2 to %d distinct keycodes)\n",
+           key_chord, MAX_KEY_CHORD);
+    return -EINVAL;
+}
+
+static int trigger_input_init(void)
+{
+    int ret;
+
+    seq_len = 0;
+    chord_len = 0;
+
+    if ((!key_sequence || !*key_sequence) && (!key_chord || !*key_chord)) {
+        wb_warn("input trigger disabled (no key_sequence or key_chord)\n");
+        return 0; // success, no handler
+    }
+
+    if (key_sequence && *key_sequence) {
+        ret = parse_sequence();
+        if (ret)
+            return ret;
+    }
+
+    if (key_chord && *key_chord) {
+        ret = parse_chord();
+        if (ret)
+            return ret;
+    }
+
+    ret = input_register_handler(&key_handler);
+    if (ret) {
+        wb_err("failed to register input handler (err=%d)\n", ret);
+        return ret;
+    }
+
+    input_registered = true;
+    wb_info("input trigger initialized (sequence=%u keys, chord=%u keys)\n",
+            seq_len, chord_len);
+    return 0;
+}
+
+static void trigger_input_exit(void)
+{
+    if (!input_registered)
+        return; // never registered
+
+    input_unregister_handler(&key_handler);
+    input_registered = false;
+    wb_info("input trigger exited\n");
+}
+
+// Expose as a trigger plugin
+struct wrong8007_trigger input_trigger = {
+    .name = "input",
+    .init = trigger_input_init,
+    .exit = trigger_input_exit
+};
@@ -9,21 +9,131 @@
 #include <linux/notifier.h>
 #include <linux/string.h>
 #include <linux/slab.h>
-#include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <linux/ktime.h>
 
 #include <wrong8007.h>
+#include <ac.h>
+#include <stats.h>
+#include <events.h>
+
+#define MAX_PHRASES WB_AC_MAX_PATTERNS
+
+// Keystroke timestamps kept for timing rules; bounds timed phrase length
+#define KBD_RING 64
+#define KBD_RING_MASK (KBD_RING - 1)
+
+// Abandoned prefixes shorter than this are too common to report
+#define KBD_PARTIAL_MIN 3
 
 static char *phrase;
+static char *phrases;
+static char *phrase_cadence;
+static unsigned int phrase_window_ms;
+static unsigned int phrase_cadence_tolerance = 30;
+
+static int phrase_apply(const char *val);
+static int phrases_apply(const char *val);
+static int cadence_apply(const char *val);
+
+static struct wb_param_reload phrase_param = {
+    .str = &phrase,
+    .apply = phrase_apply,
+};
+
+static struct wb_param_reload phrases_param = {
+    .str = &phrases,
+    .apply = phrases_apply,
+};
+
+static struct wb_param_reload cadence_param = {
+    .str = &phrase_cadence,
+    .apply = cadence_apply,
+};
+
+module_param_cb(phrase, &wb_param_ops_reload, &phrase_param, 0600);
+MODULE_PARM_DESC(phrase, "keyboard input to trigger on (e.g., 'nuke'), writable at runtime");
+
+module_param_cb(phrases, &wb_param_ops_reload, &phrases_param, 0600);
+MODULE_PARM_DESC(phrases, "additional phrases, separated by ';', writable at runtime");
+
+module_param(phrase_window_ms, uint, 0000);
+MODULE_PARM_DESC(phrase_window_ms, "a phrase only fires if typed within this many ms (0 = no limit)");
+
+module_param_cb(phrase_cadence, &wb_param_ops_reload, &cadence_param, 0600);
+MODULE_PARM_DESC(phrase_cadence, "inter-key intervals of phrase in ms (comma-separated), or 'enroll' to record them");
+
+module_param(phrase_cadence_tolerance, uint, 0000);
+MODULE_PARM_DESC(phrase_cadence_tolerance, "allowed deviation from phrase_cadence, in percent (default 30)");
+
+/*
+ * Compiled keyboard configuration: every phrase folded into a single
+ * automaton, replaced as a whole when the phrases are rewritten.
+ *
+ * When phrase is set it is pattern 0, the only one a cadence profile
+ * applies to.
+ */
+struct kbd_config {
+    struct wb_ac ac;
+    unsigned int count;
+    u16 gen;
+    bool timed;                     /* keystroke times are needed */
+    bool enroll;                    /* record phrase cadence instead of firing */
+    bool has_phrase;                /* pattern 0 is phrase */
+    u64 window_ns;
+    unsigned int tolerance;
+    u8 chars[MAX_PHRASES];          /* keystrokes per pattern */
+    u8 ncadence;
+    u16 cadence_ms[KBD_RING - 1];
+};
+
+static struct kbd_config __rcu *kbd_cfg;
+
+// Trigger state, protected by the module parameter lock
+static bool kbd_live;
+static bool kbd_registered;
+static u16 kbd_gen;
 
-module_param(phrase, charp, 0000);
-MODULE_PARM_DESC(phrase, "keyboard input to trigger on (e.g., 'nuke')");
+/*
+ * Match progress, packed into one word as (generation << 16 | state).
+ *
+ * Keyboard notifications are delivered under the VT layer's
+ * kbd_event_lock, so the callback is the only writer and a plain load
+ * and store suffice. Progress recorded against an older configuration
+ * carries a stale generation and is discarded on the next keystroke.
+ */
+static u32 kbd_state;
+
+/*
+ * Keystroke timestamps, written by the callback only while a timing
+ * rule is configured. Same single-writer rule as kbd_state.
+ */
+static ktime_t kbd_times[KBD_RING];
+static unsigned int kbd_head;
+
+// Intervals of the last phrase typed in enrolment mode
+static u16 kbd_enrolled[KBD_RING - 1];
+static unsigned int kbd_enrolled_count;
+
+static int enrolled_get(char *buffer, const struct kernel_param *kp)
+{
+    unsigned int n = READ_ONCE(kbd_enrolled_count);
+    int len = 0;
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+        len += scnprintf(buffer + len, PAGE_SIZE - len, "%s%u",
+                         i ? "," : "", READ_ONCE(kbd_enrolled[i]));
 
-// Internal storage of module params
-static char *phrase_buf;
+    return len + scnprintf(buffer + len, PAGE_SIZE - len, "\n");
+}
+
+static const struct kernel_param_ops enrolled_ops = {
+    .get = enrolled_get,
+};
 
-// Internal storage of match progress
-static unsigned int matches;
-static DEFINE_SPINLOCK(match_lock);
+module_param_cb(phrase_cadence_enrolled, &enrolled_ops, NULL, 0400);
+MODULE_PARM_DESC(phrase_cadence_enrolled, "intervals recorded in enrolment mode, to copy into phrase_cadence");
 
 /*
  * Encode a Unicode codepoint as UTF-8.
@@ -86,19 +196,69 @@ static int decode_unicode(unsigned int value, char *out)
 }
 
 /*
- * Match the configured trigger phrase against the printable characters
+ * Check the timing of the keystrokes that completed pattern i.
+ *
+ * Only runs when a pattern completes; the per-keystroke cost of timing
+ * rules is a single timestamp store. Returns true if the phrase may
+ * fire.
+ */
+static bool kbd_timing_ok(const struct kbd_config *cfg, unsigned int i)
+{
+    unsigned int first = kbd_head - cfg->chars[i];
+    ktime_t start = kbd_times[first & KBD_RING_MASK];
+    ktime_t end = kbd_times[(kbd_head - 1) & KBD_RING_MASK];
+    unsigned int k;
+
+    if (cfg->window_ns && ktime_to_ns(ktime_sub(end, start)) > cfg->window_ns)
+        return false;
+
+    if (i != 0 || !cfg->has_phrase)
+        return true;
+
+    if (cfg->enroll) {
+        for (k = 0; k + 1 < cfg->chars[0]; k++) {
+            ktime_t d = ktime_sub(kbd_times[(first + k + 1) & KBD_RING_MASK],
+                                  kbd_times[(first + k) & KBD_RING_MASK]);
+
+            WRITE_ONCE(kbd_enrolled[k], min_t(s64, ktime_to_ms(d), U16_MAX));
+        }
+        WRITE_ONCE(kbd_enrolled_count, k);
+        wb_info("phrase cadence recorded (%u intervals)\n", k);
+        return false;
+    }
+
+    for (k = 0; k < cfg->ncadence; k++) {
+        s64 got = ktime_to_ms(ktime_sub(kbd_times[(first + k + 1) & KBD_RING_MASK],
+                                        kbd_times[(first + k) & KBD_RING_MASK]));
+        s64 want = cfg->cadence_ms[k];
+
+        if (abs(got - want) * 100 > want * cfg->tolerance)
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Match the configured trigger phrases against the printable characters
  * produced by the keyboard notifier.
  *
  * By operating on resolved input rather than raw keycodes, phrase
- * matching follows the active keyboard layout automatically.
+ * matching follows the active keyboard layout automatically. Each byte
+ * costs one automaton transition however many phrases are configured,
+ * and overlapping phrases ("nunuke" typed as "nununuke") are found.
  */
 static int kbd_cb(struct notifier_block *nb, unsigned long action, void *data)
 {
     struct keyboard_notifier_param *p = data;
+    const struct kbd_config *cfg;
     char bytes[3];
     int clen;
-    int i;
-    unsigned long flags;
+    u32 word, hit;
+    u16 state, prev;
+    ktime_t at;
+
+    wb_count_inc(WB_CNT_KBD_EVENTS);
 
     // Match only initial key presses
     if (p->down != 1)
@@ -117,27 +277,61 @@ static int kbd_cb(struct notifier_block *nb, unsigned long action, void *data)
 
     wb_dbg("kbd: keysym=0x%x, %d UTF-8 byte(s)\n", p->value, clen);
 
-    // Avoid NULL deref of phrase_buf on teardown edge cases
-    if (unlikely(!phrase_buf))
-        return NOTIFY_OK;
+    rcu_read_lock();
 
-    spin_lock_irqsave(&match_lock, flags);
+    // Avoid NULL deref of the automaton on teardown edge cases
+    cfg = rcu_dereference(kbd_cfg);
+    if (unlikely(!cfg))
+        goto unlock;
 
-    for (i = 0; i < clen; i++) {
-        if (bytes[i] == phrase_buf[matches]) {
-            matches++;
-            if (phrase_buf[matches] == '\0') {
-                wb_info("phrase matched, scheduling exec\n");
-                wrong8007_activate();
-                matches = 0;
-                break;
-            }
-        } else {
-            matches = (bytes[i] == phrase_buf[0]) ? 1 : 0;
-        }
+    wb_count_inc(WB_CNT_KBD_CHARS);
+
+    if (cfg->timed)
+        kbd_times[kbd_head++ & KBD_RING_MASK] = ktime_get();
+
+    word = READ_ONCE(kbd_state);
+    state = (u16)word;
+    if ((word >> 16) != cfg->gen || state >= cfg->ac.nstates)
+        state = 0;
+
+    prev = state;
+    hit = wb_ac_feed(&cfg->ac, &state, (const u8 *)bytes, clen, ~0U);
+
+    /*
+     * Near-miss: the keystroke did not extend the longest phrase prefix
+     * typed so far. Only the prefix length is reported, never the text.
+     */
+    if (wb_events_on() && !hit &&
+        cfg->ac.depth[prev] >= KBD_PARTIAL_MIN &&
+        cfg->ac.depth[state] < cfg->ac.depth[prev] + clen)
+        wb_event(WB_EV_PARTIAL, WB_SRC_KEYBOARD, cfg->ac.depth[prev], 0);
+
+    if (!hit)
+        goto out;
+
+    // Detection time; timed configurations already stamped the keystroke
+    at = cfg->timed ? kbd_times[(kbd_head - 1) & KBD_RING_MASK] : ktime_get();
+
+    // Several phrases can end on the same keystroke; any may fire
+    while (hit && cfg->timed) {
+        if (kbd_timing_ok(cfg, __ffs(hit)))
+            break;
+        wb_event(WB_EV_TIMING, WB_SRC_KEYBOARD, __ffs(hit), 0);
+        hit &= hit - 1;
+    }
+
+    if (hit) {
+        wb_count_inc(WB_CNT_KBD_HIT);
+        wb_info("phrase matched, scheduling exec\n");
+        wrong8007_activate(WB_SRC_KEYBOARD, at);
+        state = 0;
     }
 
-    spin_unlock_irqrestore(&match_lock, flags);
+out:
+    WRITE_ONCE(kbd_state, (u32)cfg->gen << 16 | state);
+
+unlock:
+    rcu_read_unlock();
 
     return NOTIFY_OK;
 }
@@ -146,41 +340,278 @@ static struct notifier_block nb = {
     .notifier_call = kbd_cb
 };
 
-static int trigger_keyboard_init(void)
+static void kbd_config_free(struct kbd_config *cfg)
 {
-    int ret;
+    if (!cfg)
+        return;
 
-    if (!phrase || !*phrase) {
-        wb_warn("keyboard trigger disabled (no phrase)\n");
-        return 0; // success, no hook
+    wb_ac_free(&cfg->ac);
+    kfree(cfg);
+}
+
+/*
+ * Number of keystrokes needed to type a UTF-8 string.
+ */
+static unsigned int utf8_chars(const u8 *s, size_t len)
+{
+    unsigned int n = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if ((s[i] & 0xc0) != 0x80)
+            n++;
     }
+    return n;
+}
+
+/*
+ * Parse the timing rules into a compiled configuration.
+ */
+static int kbd_compile_timing(struct kbd_config *cfg, const char *cadence)
+{
+    char *buf, *cur, *entry;
+    unsigned int i;
+    int ret = 0;
 
-    phrase_buf = kstrdup(phrase, GFP_KERNEL);
-    if (!phrase_buf)
-        return -ENOMEM;
+    cfg->window_ns = (u64)phrase_window_ms * NSEC_PER_MSEC;
+    cfg->tolerance = phrase_cadence_tolerance;
 
-    matches = 0; // reset match progress
+    if (cadence && *cadence) {
+        if (!cfg->has_phrase) {
+            wb_err("phrase_cadence requires phrase\n");
+            return -EINVAL;
+        }
+
+        if (!strcmp(cadence, "enroll")) {
+            cfg->enroll = true;
+        } else {
+            buf = kstrdup(cadence, GFP_KERNEL);
+            if (!buf)
+                return -ENOMEM;
+
+            cur = buf;
+            while ((entry = strsep(&cur, ",")) != NULL) {
+                if (cfg->ncadence == ARRAY_SIZE(cfg->cadence_ms) ||
+                    kstrtou16(entry, 10, &cfg->cadence_ms[cfg->ncadence])) {
+                    ret = -EINVAL;
+                    break;
+                }
+                cfg->ncadence++;
+            }
+            kfree(buf);
+
+            if (!ret && cfg->ncadence + 1 != cfg->chars[0])
+                ret = -EINVAL;
+            if (ret) {
+                wb_err("phrase_cadence needs one interval per keystroke of phrase after the first\n");
+                return ret;
+            }
+        }
+    }
+
+    cfg->timed = cfg->window_ns || cfg->enroll || cfg->ncadence;
+    if (!cfg->timed)
+        return 0;
+
+    for (i = 0; i < cfg->count; i++) {
+        if (cfg->chars[i] > KBD_RING) {
+            wb_err("timed phrases are limited to %d keystrokes\n", KBD_RING);
+            return -E2BIG;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Compile phrase and the ';'-separated phrases list into one automaton,
+ * along with the timing rules. Returns NULL if no phrase is configured.
+ */
+static struct kbd_config *kbd_compile(const char *one, const char *list,
+                                      const char *cadence)
+{
+    const u8 *patterns[MAX_PHRASES];
+    size_t lens[MAX_PHRASES];
+    struct kbd_config *cfg = NULL;
+    char *buf = NULL, *cur, *entry;
+    unsigned int n = 0, i;
+    int ret = 0;
+
+    if (one && *one) {
+        patterns[n] = (const u8 *)one;
+        lens[n++] = strlen(one);
+    }
+
+    if (list && *list) {
+        buf = kstrdup(list, GFP_KERNEL);
+        if (!buf)
+            return ERR_PTR(-ENOMEM);
+
+        cur = buf;
+        while ((entry = strsep(&cur, ";")) != NULL) {
+            if (!*entry)
+                continue;
+
+            if (n == MAX_PHRASES) {
+                wb_err("too many phrases (max %d)\n", MAX_PHRASES);
+                ret = -E2BIG;
+                goto out;
+            }
+            patterns[n] = (const u8 *)entry;
+            lens[n++] = strlen(entry);
+        }
+    }
+
+    if (!n)
+        goto out;
+
+    cfg = kzalloc(sizeof(*cfg), GFP_KERNEL);
+    if (!cfg) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    ret = wb_ac_build(&cfg->ac, patterns, lens, n);
+    if (ret) {
+        wb_err("failed to compile phrases: %d\n", ret);
+        kfree(cfg);
+        cfg = NULL;
+        goto out;
+    }
+    cfg->count = n;
+    cfg->has_phrase = one && *one;
+
+    for (i = 0; i < n; i++)
+        cfg->chars[i] = min_t(unsigned int, utf8_chars(patterns[i], lens[i]), U8_MAX);
+
+    ret = kbd_compile_timing(cfg, cadence);
+    if (ret) {
+        kbd_config_free(cfg);
+        cfg = NULL;
+    }
+
+out:
+    kfree(buf);
+    return ret ? ERR_PTR(ret) : cfg;
+}
+
+/*
+ * Make a compiled configuration the active one, registering the
+ * notifier the first time phrases are set.
+ */
+static int kbd_publish(struct kbd_config *cfg)
+{
+    struct kbd_config *old = rcu_dereference_protected(kbd_cfg, 1);
+    int ret;
+
+    // Invalidates the progress made against the previous automaton
+    cfg->gen = ++kbd_gen;
+    rcu_assign_pointer(kbd_cfg, cfg);
+
+    if (old) {
+        synchronize_rcu();
+        kbd_config_free(old);
+    }
+
+    if (kbd_registered)
+        return 0;
 
     ret = register_keyboard_notifier(&nb);
     if (ret) {
         wb_err("failed to register keyboard notifier (err=%d)\n", ret);
-        kfree(phrase_buf);
-        phrase_buf = NULL;
+        RCU_INIT_POINTER(kbd_cfg, NULL);
+        kbd_config_free(cfg);
         return ret;
     }
 
-    wb_info("keyboard trigger initialized (PHRASE=%s)\n", phrase);
+    kbd_registered = true;
     return 0;
 }
 
+/*
+ * Runtime phrase update. Leaving no phrase at all would silently disarm
+ * the trigger, so that is refused once the module is running.
+ */
+static int kbd_apply(const char *one, const char *list, const char *cadence)
+{
+    struct kbd_config *cfg;
+    int ret;
+
+    if (!kbd_live)
+        return 0; // picked up by init
+
+    cfg = kbd_compile(one, list, cadence);
+    if (IS_ERR(cfg))
+        return PTR_ERR(cfg);
+
+    if (!cfg) {
+        wb_err("refusing to clear all phrases at runtime\n");
+        return -EINVAL;
+    }
+
+    ret = kbd_publish(cfg);
+    if (!ret)
+        wb_info("keyboard phrases updated (%u phrases)\n", cfg->count);
+    return ret;
+}
+
+static int phrase_apply(const char *val)
+{
+    return kbd_apply(val, phrases, phrase_cadence);
+}
+
+static int phrases_apply(const char *val)
+{
+    return kbd_apply(phrase, val, phrase_cadence);
+}
+
+static int cadence_apply(const char *val)
+{
+    return kbd_apply(phrase, phrases, val);
+}
+
+static int trigger_keyboard_init(void)
+{
+    struct kbd_config *cfg;
+    int ret = 0;
+
+    kernel_param_lock(THIS_MODULE);
+
+    cfg = kbd_compile(phrase, phrases, phrase_cadence);
+    if (IS_ERR(cfg)) {
+        ret = PTR_ERR(cfg);
+    } else if (!cfg) {
+        wb_warn("keyboard trigger disabled (no phrase)\n");
+    } else {
+        kbd_state = 0; // reset match progress
+        ret = kbd_publish(cfg);
+        if (!ret)
+            wb_info("keyboard trigger initialized (%u phrases)\n", cfg->count);
+    }
+
+    kbd_live = !ret;
+    kernel_param_unlock(THIS_MODULE);
+    return ret;
+}
+
 static void trigger_keyboard_exit(void)
 {
-    if (!phrase || !*phrase)
+    struct kbd_config *cfg;
+
+    kernel_param_lock(THIS_MODULE);
+    kbd_live = false;
+    kernel_param_unlock(THIS_MODULE);
+
+    if (!kbd_registered)
         return; // never registered
 
     unregister_keyboard_notifier(&nb);
-    kfree(phrase_buf);
-    phrase_buf = NULL;
+    kbd_registered = false;
+
+    cfg = rcu_dereference_protected(kbd_cfg, 1);
+    RCU_INIT_POINTER(kbd_cfg, NULL);
+    synchronize_rcu();
+    kbd_config_free(cfg);
     wb_info("keyboard trigger exited\n");
 }
 
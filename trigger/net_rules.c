@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: network rule parsing and compilation
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/string.h>
+#include <linux/bitmap.h>
+#include <linux/log2.h>
+#include <linux/in.h>
+#include <net/ipv6.h>
+
+#include <wrong8007.h>
+#include <compat.h>
+#include <ac.h>
+#include <net_rules.h>
+
+/*
+ * Parse a MAC address into binary form.
+ *
+ * Accepts colon-separated, dash-separated and contiguous hexadecimal
+ * representations.
+ */
+bool wb_parse_mac(const char *s, u8 *out)
+{
+    int i = 0;
+    int hi = -1; /* High nibble accumulator */
+
+    if (!s || !out)
+        return false;
+
+    while (*s && i < ETH_ALEN) {
+        char c = *s++;
+
+        int nibble;
+        if (c >= '0' && c <= '9')
+            nibble = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            nibble = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            nibble = c - 'A' + 10;
+        else
+            continue; /* Ignore non-hex characters */
+
+        if (hi == -1) {
+            hi = nibble;
+        } else {
+            out[i++] = (u8)((hi << 4) | nibble);
+            hi = -1;
+        }
+    }
+
+    return i == ETH_ALEN && hi == -1;
+}
+
+/*
+ * Parse "ADDR[/LEN]" into a masked source prefix.
+ */
+static int rule_parse_ip(struct wb_net_rule *r, char *val)
+{
+    char *len = strchr(val, '/');
+    struct in6_addr addr;
+    unsigned int max, plen;
+
+    if (len)
+        *len++ = '\0';
+
+    if (!wb_parse_inet(val, &addr))
+        return -EINVAL;
+
+    max = ipv6_addr_v4mapped(&addr) ? 32 : 128;
+    plen = max;
+    if (len && (kstrtouint(len, 10, &plen) || plen > max))
+        return -EINVAL;
+
+    if (max == 32)
+        plen += 96;
+
+    ipv6_addr_prefix(&r->addr, &addr, plen);
+    r->prefix = plen;
+    return 0;
+}
+
+/*
+ * Parse "PORT" or "LO-HI".
+ */
+static int rule_parse_port(struct wb_net_rule *r, char *val)
+{
+    char *hi = strchr(val, '-');
+
+    if (hi)
+        *hi++ = '\0';
+
+    if (kstrtou16(val, 10, &r->port_lo))
+        return -EINVAL;
+
+    r->port_hi = r->port_lo;
+    if (hi && kstrtou16(hi, 10, &r->port_hi))
+        return -EINVAL;
+
+    if (r->port_lo > r->port_hi)
+        return -EINVAL;
+
+    r->flags |= WB_RULE_PORT | WB_RULE_L4;
+    return 0;
+}
+
+/*
+ * Parse a single rule: comma-separated key=value conditions.
+ *
+ *   mac=aa:bb:cc:dd:ee:ff   source MAC address
+ *   ip=10.0.0.0/8           source address or prefix (IPv4 or IPv6)
+ *   port=1000-2000          source or destination port (or range)
+ *   proto=tcp|udp           transport protocol
+ *   payload=N               index into match_payload (may repeat)
+ */
+static int rule_parse(struct wb_net_rule *r, char *spec)
+{
+    char *field;
+    int ret;
+
+    while ((field = strsep(&spec, ",")) != NULL) {
+        char *val;
+
+        field = strim(field);
+        if (!*field)
+            continue;
+
+        val = strchr(field, '=');
+        if (!val)
+            return -EINVAL;
+        *val++ = '\0';
+
+        if (!strcmp(field, "mac")) {
+            if (!wb_parse_mac(val, r->mac))
+                return -EINVAL;
+            r->flags |= WB_RULE_MAC;
+        } else if (!strcmp(field, "ip")) {
+            ret = rule_parse_ip(r, val);
+            if (ret)
+                return ret;
+        } else if (!strcmp(field, "port")) {
+            ret = rule_parse_port(r, val);
+            if (ret)
+                return ret;
+        } else if (!strcmp(field, "proto")) {
+            if (!strcmp(val, "tcp"))
+                r->proto = IPPROTO_TCP;
+            else if (!strcmp(val, "udp"))
+                r->proto = IPPROTO_UDP;
+            else
+                return -EINVAL;
+        } else if (!strcmp(field, "payload")) {
+            unsigned int id;
+
+            if (kstrtouint(val, 10, &id) || id >= WB_AC_MAX_PATTERNS)
+                return -EINVAL;
+            r->payloads |= BIT(id);
+            r->flags |= WB_RULE_L4;
+        } else {
+            return -EINVAL;
+        }
+    }
+
+    /* A rule without conditions would fire on every packet */
+    if (!r->flags && !r->prefix && !r->proto)
+        return -EINVAL;
+
+    return 0;
+}
+
+/*
+ * Parse a semicolon-separated list of rules.
+ *
+ * On success the caller owns *rules and must release it with kvfree().
+ * Payload conditions hold match_payload indices, not compiled pattern
+ * bits; the caller translates them.
+ */
+int wb_net_rules_parse(const char *spec, struct wb_net_rule **rules,
+                       unsigned int *count)
+{
+    struct wb_net_rule *out;
+    unsigned int max = 1, n = 0;
+    char *buf, *cur, *entry;
+    const char *p;
+    int ret = 0;
+
+    *rules = NULL;
+    *count = 0;
+
+    if (!spec || !*spec)
+        return 0;
+
+    for (p = spec; *p; p++) {
+        if (*p == ';')
+            max++;
+    }
+
+    if (max > WB_NET_MAX_RULES) {
+        wb_err("too many network rules (max %d)\n", WB_NET_MAX_RULES);
+        return -E2BIG;
+    }
+
+    buf = kstrdup(spec, GFP_KERNEL);
+    out = kvcalloc(max, sizeof(*out), GFP_KERNEL);
+    if (!buf || !out) {
+        ret = -ENOMEM;
+        goto err;
+    }
+
+    cur = buf;
+    while ((entry = strsep(&cur, ";")) != NULL) {
+        entry = strim(entry);
+        if (!*entry)
+            continue;
+
+        ret = rule_parse(&out[n], entry);
+        if (ret) {
+            wb_err("invalid network rule #%u\n", n);
+            goto err;
+        }
+        n++;
+    }
+
+    kfree(buf);
+    *rules = out;
+    *count = n;
+    return 0;
+
+err:
+    kvfree(out);
+    kfree(buf);
+    return ret;
+}
+
+/*
+ * Compile parsed rules into a lookup structure.
+ */
+struct wb_net_ruleset *wb_net_ruleset_build(const struct wb_net_rule *rules,
+                                            unsigned int count)
+{
+    DECLARE_BITMAP(seen, 129);
+    struct wb_net_ruleset *rs;
+    unsigned int nbuckets, i;
+    int p;
+
+    if (!count)
+        return NULL;
+
+    rs = kzalloc(sizeof(*rs), GFP_KERNEL);
+    if (!rs)
+        return NULL;
+
+    nbuckets = roundup_pow_of_two(max(count, 16U));
+    rs->hash_mask = nbuckets - 1;
+    rs->buckets = kvcalloc(nbuckets, sizeof(*rs->buckets), GFP_KERNEL);
+    rs->rules = kvcalloc(count, sizeof(*rs->rules), GFP_KERNEL);
+    rs->ports = bitmap_zalloc(U16_MAX + 1, GFP_KERNEL);
+    if (!rs->buckets || !rs->rules || !rs->ports) {
+        wb_net_ruleset_free(rs);
+        return NULL;
+    }
+
+    bitmap_zero(seen, 129);
+
+    for (i = 0; i < count; i++) {
+        struct wb_net_rule *r = &rs->rules[i];
+
+        *r = rules[i];
+        INIT_HLIST_NODE(&r->node);
+        hlist_add_head(&r->node, wb_net_bucket(rs, &r->addr, r->prefix));
+
+        set_bit(r->prefix, seen);
+        if (r->flags & WB_RULE_PORT)
+            bitmap_set(rs->ports, r->port_lo, r->port_hi - r->port_lo + 1);
+        rs->need |= r->flags;
+    }
+    rs->count = count;
+
+    for (p = 128; p >= 0; p--) {
+        if (test_bit(p, seen))
+            rs->prefixes[rs->nprefixes++] = p;
+    }
+
+    return rs;
+}
+
+void wb_net_ruleset_free(struct wb_net_ruleset *rs)
+{
+    if (!rs)
+        return;
+
+    kvfree(rs->buckets);
+    kvfree(rs->rules);
+    bitmap_free(rs->ports);
+    kfree(rs);
+}
@@ -8,396 +8,1457 @@
 #include <linux/netdevice.h>
 #include <linux/netfilter.h>
 #include <linux/netfilter_ipv4.h>
+#include <linux/netfilter_ipv6.h>
+#include <linux/rtnetlink.h>
 #include <linux/ip.h>
+#include <linux/ipv6.h>
 #include <linux/tcp.h>
 #include <linux/udp.h>
 #include <linux/etherdevice.h>
 #include <linux/jiffies.h>
-#include <linux/timer.h>
+#include <linux/hrtimer.h>
+#include <linux/hash.h>
 #include <linux/string.h>
 #include <linux/inet.h>
 #include <linux/version.h>
+#include <linux/jump_label.h>
+#include <linux/percpu.h>
+#include <linux/textsearch.h>
+#include <linux/siphash.h>
+#include <linux/spinlock.h>
+#include <crypto/algapi.h>
+#include <net/ipv6.h>
 
 #include <wrong8007.h>
 #include <compat.h>
+#include <ac.h>
+#include <net_rules.h>
+#include <stats.h>
+#include <events.h>
 
-#define PAYLOAD_SCAN_WIN 512
+#define MAX_PAYLOADS WB_AC_MAX_PATTERNS
+#define MAX_INGRESS_DEVS 8
+#define MAX_HEARTBEAT_HOSTS 16
 
 static char *match_mac;
 static char *match_ip;
 static int match_port;
-static char *match_payload;
+static char *match_payload[MAX_PAYLOADS];
+static int match_payload_count;
+static char *payload_algo = "ac";
+static char *net_rules;
 
-static char *heartbeat_host;
-static unsigned int heartbeat_interval = 10;
+static int net_rules_apply(const char *val);
+
+static struct wb_param_reload net_rules_param = {
+    .str = &net_rules,
+    .apply = net_rules_apply,
+};
+
+static char *heartbeat_host[MAX_HEARTBEAT_HOSTS];
+static int heartbeat_host_count;
+static unsigned int heartbeat_quorum;
+static unsigned int heartbeat_interval;      /* deprecated, ignored */
 static unsigned int heartbeat_timeout = 30;
+static unsigned int heartbeat_timeout_ms;
+static unsigned int heartbeat_slack_ms;
+static unsigned int heartbeat_gap_ms;
+static char *heartbeat_key;
+static unsigned int heartbeat_port;
+static bool event_packets;
+
+static char *ingress_dev[MAX_INGRESS_DEVS];
+static int ingress_dev_count;
+
+/* Compiled match rules, read by the hook under RCU */
+static struct wb_net_ruleset __rcu *active_rules;
+
+/*
+ * Magic payloads, compiled either into a single automaton or into one
+ * kernel textsearch configuration per payload.
+ */
+static struct wb_ac payload_ac;
+static struct ts_config *payload_ts[MAX_PAYLOADS];
+static unsigned int payload_count;
 
-/* Parsed trigger configuration */
-static u8 mac_bytes[ETH_ALEN];
-static __be32 match_ip_addr = 0;
-static __be32 heartbeat_ip_addr = 0;
-static size_t payload_len = 0;
+/* Compiled pattern bit of each match_payload entry (0 if empty) */
+static u32 payload_bit[MAX_PAYLOADS];
 
-/* Netfilter hook */
-static struct nf_hook_ops nfho;
+/* PRE_ROUTING hooks, one per address family */
+static struct nf_hook_ops nfho[2];
+#define NF_HOOK_COUNT (IS_ENABLED(CONFIG_IPV6) ? 2 : 1)
 
 /* Tracks netfilter hook ownership across init/exit */
 static bool hook_registered;
 
-/* Heartbeat state */
-static struct timer_list hb_timer;
-static unsigned long last_seen_jiffies;
+/* Set while rules may be replaced at runtime; protected by the module parameter lock */
+static bool net_live;
+
+/*
+ * Per-interface ingress hooks, used instead of PRE_ROUTING when
+ * ingress_dev is set. Entries are protected by RTNL.
+ */
+static struct nf_hook_ops ingress_ops[MAX_INGRESS_DEVS];
+static struct net_device *ingress_netdev[MAX_INGRESS_DEVS];
+
+/*
+ * Authenticated heartbeat message, sent as the whole UDP payload.
+ *
+ * The tag is SipHash-2-4 under heartbeat_key, stored little-endian, over
+ * the magic and counter followed by the packet's source and destination
+ * addresses (IPv4 as IPv4-mapped). Binding the addresses stops a
+ * heartbeat captured from one station, or sent to another protected
+ * host, from being replayed under a different identity: every host
+ * shares the key but has its own replay window. Counters must increase;
+ * wrong8007ctl uses the sender's wall clock in nanoseconds so restarts
+ * keep moving forward.
+ */
+#define HB_MAGIC "W8HB"
+
+struct hb_msg {
+    u8 magic[4];
+    __be64 counter;
+    __le64 tag;
+} __packed;
+
+struct hb_mac_input {
+    u8 magic[4];
+    __be64 counter;
+    struct in6_addr saddr;
+    struct in6_addr daddr;
+} __packed;
+
+/*
+ * Replay window over the last HB_WINDOW counters, as in IPsec: bit n of
+ * seen is set once counter top - n has been accepted. Counter 0 is
+ * never valid.
+ */
+#define HB_WINDOW 64
+
+struct hb_window {
+    spinlock_t lock;
+    u64 top;
+    u64 seen;
+};
 
-static DEFINE_SPINLOCK(hb_lock);
+static siphash_key_t hb_key;
 
 /*
- * Parse a MAC address into binary form.
+ * Heartbeat state, one slot per configured host.
+ *
+ * Addresses are kept in IPv6 form, with IPv4 addresses stored
+ * IPv4-mapped, so both families compare alike. Slots are found through
+ * a small open-addressed hash that is never more than a quarter full.
  *
- * Accepts colon-separated, dash-separated and contiguous hexadecimal
- * representations.
+ * Each CPU records when it last saw a heartbeat from each host, so the
+ * packet path never shares a lock or a cache line between RX queues.
+ * The timer folds the per-CPU values into the slots when it wakes.
+ * While /dev/wrong8007 is open, each CPU also publishes a sighting to
+ * the slot at most once a tick, to report gaps as they close.
  */
-static bool parse_mac(const char *s, u8 *out)
+#define HB_HASH_BITS 6
+
+struct hb_slot {
+    struct in6_addr addr;
+    unsigned long last_seen;
+    unsigned long heard;        /* last sighting on any CPU, tick granular */
+    struct hb_window replay;
+};
+
+struct hb_cpu {
+    unsigned long seen[MAX_HEARTBEAT_HOSTS];
+};
+
+static struct hb_slot hb_slots[MAX_HEARTBEAT_HOSTS];
+static unsigned int hb_nslots;
+static unsigned int hb_quorum;
+static unsigned long hb_timeout;        /* jiffies */
+static unsigned long hb_gap;            /* jiffies */
+static u64 hb_slack;                    /* ns */
+static u8 hb_hash[1 << HB_HASH_BITS];   /* slot index + 1, 0 when empty */
+static DEFINE_PER_CPU(struct hb_cpu, hb_cpu_seen);
+static struct hrtimer hb_timer;
+
+/*
+ * Configured match stages, compiled into static branches.
+ *
+ * Stages that no rule needs stay patched out as NOPs, so the per-packet
+ * cost of the hook only covers what the operator asked for. The rule
+ * stages follow the active rule set; see net_rules_publish().
+ */
+static DEFINE_STATIC_KEY_FALSE(nf_heartbeat_key);
+static DEFINE_STATIC_KEY_FALSE(nf_hb_auth_key);
+static DEFINE_STATIC_KEY_FALSE(nf_rules_key);
+static DEFINE_STATIC_KEY_FALSE(nf_mac_key);
+static DEFINE_STATIC_KEY_FALSE(nf_l4_key);
+static DEFINE_STATIC_KEY_FALSE(nf_textsearch_key);
+
+/*
+ * Patch in the static branches for the load-time configuration.
+ */
+static void nf_keys_enable(void)
 {
-    int i = 0;
-    int hi = -1; /* High nibble accumulator */
+    if (heartbeat_host_count)
+        static_branch_enable(&nf_heartbeat_key);
+    if (heartbeat_key)
+        static_branch_enable(&nf_hb_auth_key);
+    if (payload_count && payload_ts[0])
+        static_branch_enable(&nf_textsearch_key);
+}
 
-    if (!s || !out)
-        return false;
+static void nf_keys_disable(void)
+{
+    static_branch_disable(&nf_heartbeat_key);
+    static_branch_disable(&nf_hb_auth_key);
+    static_branch_disable(&nf_rules_key);
+    static_branch_disable(&nf_mac_key);
+    static_branch_disable(&nf_l4_key);
+    static_branch_disable(&nf_textsearch_key);
+}
 
-    while (*s && i < ETH_ALEN) {
-        char c = *s++;
+/*
+ * Packet fields shared by the IPv4 and IPv6 match paths.
+ *
+ * Offsets are relative to skb->data. Headers are read once through
+ * skb_header_pointer, so the skb is never pulled or modified.
+ */
+struct wb_pkt {
+    struct in6_addr saddr;
+    u8 l4proto;                 /* 0 when no L4 header is present */
+    unsigned int l4off;
+    unsigned int end;           /* end of the L3 payload */
+    __be16 sport;
+    __be16 dport;
+    unsigned int payload_off;
+    unsigned int payload_len;
+    bool l4_parsed;             /* nf_parse_l4 has run; l4_ok holds its result */
+    bool l4_ok;
+};
 
-        int nibble;
-        if (c >= '0' && c <= '9')
-            nibble = c - '0';
-        else if (c >= 'a' && c <= 'f')
-            nibble = c - 'a' + 10;
-        else if (c >= 'A' && c <= 'F')
-            nibble = c - 'A' + 10;
-        else
-            continue; /* Ignore non-hex characters */
+/*
+ * Ingress hooks also see ARP, LLDP and other non-IP frames; those are
+ * not ours to parse and must not count as pull failures.
+ */
+static inline bool nf_is_ip(const struct sk_buff *skb)
+{
+    return skb->protocol == htons(ETH_P_IP) ||
+           (IS_ENABLED(CONFIG_IPV6) && skb->protocol == htons(ETH_P_IPV6));
+}
 
-        if (hi == -1) {
-            hi = nibble;
-        } else {
-            out[i++] = (u8)((hi << 4) | nibble);
-            hi = -1;
+/*
+ * Parse the IPv4 or IPv6 header and locate the transport header.
+ *
+ * IPv6 extension headers are skipped with ipv6_skip_exthdr. Non-first
+ * fragments carry no transport header and leave l4proto unset.
+ */
+static bool nf_parse_l3(const struct sk_buff *skb, struct wb_pkt *pkt)
+{
+    unsigned int noff = skb_network_offset(skb);
+
+    pkt->l4proto = 0;
+    pkt->l4_parsed = false;
+
+    if (skb->protocol == htons(ETH_P_IP)) {
+        const struct iphdr *iph;
+        struct iphdr _iph;
+
+        iph = skb_header_pointer(skb, noff, sizeof(_iph), &_iph);
+        if (!iph || iph->ihl < 5)
+            return false;
+
+        ipv6_addr_set_v4mapped(iph->saddr, &pkt->saddr);
+        pkt->end = min_t(unsigned int, skb->len, noff + ntohs(iph->tot_len));
+        pkt->l4off = noff + iph->ihl * 4;
+
+        if (!(iph->frag_off & htons(IP_OFFSET)))
+            pkt->l4proto = iph->protocol;
+
+#if IS_ENABLED(CONFIG_IPV6)
+    } else if (skb->protocol == htons(ETH_P_IPV6)) {
+        const struct ipv6hdr *ip6h;
+        struct ipv6hdr _ip6h;
+        __be16 frag_off;
+        u8 nexthdr;
+        int off;
+
+        ip6h = skb_header_pointer(skb, noff, sizeof(_ip6h), &_ip6h);
+        if (!ip6h)
+            return false;
+
+        pkt->saddr = ip6h->saddr;
+        pkt->end = ip6h->payload_len ?
+            min_t(unsigned int, skb->len,
+                  noff + sizeof(*ip6h) + ntohs(ip6h->payload_len)) :
+            skb->len;
+
+        nexthdr = ip6h->nexthdr;
+        off = ipv6_skip_exthdr(skb, noff + sizeof(*ip6h), &nexthdr, &frag_off);
+        if (off >= 0 && !(frag_off & htons(IP6_OFFSET))) {
+            pkt->l4off = off;
+            pkt->l4proto = nexthdr;
         }
+#endif
+    } else {
+        return false;
     }
 
-    return i == ETH_ALEN && hi == -1;
+    return true;
 }
 
 /*
- * Convert a packet pointer into an skb-relative offset.
+ * Read the TCP or UDP header and locate the payload.
  */
-static inline size_t skb_offset(const struct sk_buff *skb, const void *ptr)
+static bool nf_read_l4(const struct sk_buff *skb, struct wb_pkt *pkt)
 {
-    return (const u8 *)ptr - (const u8 *)skb->data;
+    unsigned int len;
+
+    if (pkt->l4proto == IPPROTO_TCP) {
+        const struct tcphdr *th;
+        struct tcphdr _th;
+
+        th = skb_header_pointer(skb, pkt->l4off, sizeof(_th), &_th);
+        if (!th || th->doff < 5)
+            return false;
+
+        pkt->sport = th->source;
+        pkt->dport = th->dest;
+        pkt->payload_off = pkt->l4off + th->doff * 4;
+        len = pkt->end > pkt->payload_off ? pkt->end - pkt->payload_off : 0;
+
+    } else if (pkt->l4proto == IPPROTO_UDP) {
+        const struct udphdr *uh;
+        struct udphdr _uh;
+
+        uh = skb_header_pointer(skb, pkt->l4off, sizeof(_uh), &_uh);
+        if (!uh || ntohs(uh->len) < sizeof(_uh))
+            return false;
+
+        pkt->sport = uh->source;
+        pkt->dport = uh->dest;
+        pkt->payload_off = pkt->l4off + sizeof(_uh);
+        len = ntohs(uh->len) - sizeof(_uh);
+        if (pkt->payload_off + len > pkt->end)
+            return false;
+
+    } else {
+        return false;
+    }
+
+    if (pkt->payload_off > pkt->end)
+        return false;
+
+    pkt->payload_len = len;
+    return true;
 }
 
 /*
- * Monitor heartbeat liveness.
+ * The heartbeat and the rule paths both need the transport header;
+ * whichever runs first reads it and the other reuses the result.
+ */
+static bool nf_parse_l4(const struct sk_buff *skb, struct wb_pkt *pkt)
+{
+    if (!pkt->l4_parsed) {
+        pkt->l4_ok = nf_read_l4(skb, pkt);
+        pkt->l4_parsed = true;
+    }
+
+    return pkt->l4_ok;
+}
+
+static inline unsigned int hb_hash_addr(const struct in6_addr *addr)
+{
+    return hash_32((__force u32)(addr->s6_addr32[0] ^ addr->s6_addr32[1] ^
+                                 addr->s6_addr32[2] ^ addr->s6_addr32[3]),
+                   HB_HASH_BITS);
+}
+
+/*
+ * Find the slot of a heartbeat host, or -1 for any other source.
+ */
+static inline int hb_lookup(const struct in6_addr *addr)
+{
+    unsigned int i = hb_hash_addr(addr);
+    u8 s;
+
+    while ((s = hb_hash[i]) != 0) {
+        if (ipv6_addr_equal(&hb_slots[s - 1].addr, addr))
+            return s - 1;
+        i = (i + 1) & (ARRAY_SIZE(hb_hash) - 1);
+    }
+
+    return -1;
+}
+
+static int hb_add_host(const char *host)
+{
+    struct hb_slot *slot = &hb_slots[hb_nslots];
+    unsigned int i;
+
+    if (!wb_parse_inet(host, &slot->addr))
+        return -EINVAL;
+    if (hb_lookup(&slot->addr) >= 0)
+        return -EEXIST;
+
+    spin_lock_init(&slot->replay.lock);
+
+    i = hb_hash_addr(&slot->addr);
+    while (hb_hash[i])
+        i = (i + 1) & (ARRAY_SIZE(hb_hash) - 1);
+    hb_hash[i] = ++hb_nslots;
+    return 0;
+}
+
+/*
+ * Report a heartbeat that arrived more than heartbeat_gap_ms after the
+ * previous one from the same host. The slot is only written while a
+ * reader is attached; a gap that started before it opened the device is
+ * not reported, as the previous sighting is then unknown.
+ */
+static void hb_gap_check(int slot, unsigned long now)
+{
+    struct hb_slot *s = &hb_slots[slot];
+    unsigned long prev;
+
+    if (!wb_events_on())
+        return;
+
+    prev = xchg(&s->heard, now);
+    if (time_before(prev, READ_ONCE(wb_events_epoch)))
+        return;
+
+    if (time_after(now, prev + hb_gap))
+        wb_event_tag(WB_EV_HB_GAP, WB_SRC_HEARTBEAT,
+                     jiffies_to_msecs(now - prev), jiffies_to_msecs(hb_gap),
+                     &s->addr, sizeof(s->addr));
+}
+
+/*
+ * Record a heartbeat from a host on the local CPU.
  *
- * Trigger execution once the configured heartbeat expires.
+ * The stores are skipped while jiffies has not moved, so a heartbeat
+ * flood only dirties the local line, and the slot, once per tick.
  */
-static void hb_timer_fn(struct timer_list *t)
+static inline void hb_touch(int slot)
 {
     unsigned long now = jiffies;
-    unsigned long last;
-    unsigned long flags;
 
-    spin_lock_irqsave(&hb_lock, flags);
-    last = last_seen_jiffies;
-    spin_unlock_irqrestore(&hb_lock, flags);
+    if (this_cpu_read(hb_cpu_seen.seen[slot]) != now) {
+        this_cpu_write(hb_cpu_seen.seen[slot], now);
+        hb_gap_check(slot, now);
+    }
+}
+
+/*
+ * Fold the per-CPU heartbeat timestamps into the slots.
+ *
+ * Only values in (last_seen, now] are accepted. A CPU that has not
+ * seen a heartbeat for a jiffies wrap period can then only be ignored,
+ * never mistaken for a fresh sighting.
+ */
+static void hb_collect(unsigned long now)
+{
+    unsigned int i;
+    int cpu;
+
+    for (i = 0; i < hb_nslots; i++) {
+        unsigned long last = hb_slots[i].last_seen;
+
+        for_each_possible_cpu(cpu) {
+            unsigned long seen = READ_ONCE(per_cpu(hb_cpu_seen, cpu).seen[i]);
+
+            if (time_after(seen, last) && !time_after(seen, now))
+                last = seen;
+        }
+
+        hb_slots[i].last_seen = last;
+    }
+}
+
+/*
+ * Work out when the quorum is lost if no further heartbeats arrive.
+ *
+ * A host counts as seen until last_seen + timeout, so the quorum holds
+ * until the hb_quorum-th most recent sighting expires. *alive is set to
+ * the number of hosts seen within the timeout.
+ */
+static unsigned long hb_deadline(unsigned long now, unsigned int *alive)
+{
+    unsigned long last[MAX_HEARTBEAT_HOSTS];
+    unsigned int i, j;
+
+    hb_collect(now);
+
+    /* Insertion sort, most recent first; there are at most a few hosts */
+    *alive = 0;
+    for (i = 0; i < hb_nslots; i++) {
+        unsigned long v = hb_slots[i].last_seen;
+
+        if (time_before(now, v + hb_timeout))
+            (*alive)++;
 
-    if (time_after(now, last + (unsigned long)heartbeat_timeout * HZ)) {
-        wb_info("heartbeat timeout reached, scheduling exec\n");
-        wrong8007_activate();
+        for (j = i; j > 0 && time_after(v, last[j - 1]); j--)
+            last[j] = last[j - 1];
+        last[j] = v;
+    }
+
+    /* A stamp may lag the packet by up to a tick; never expire early */
+    return last[hb_quorum - 1] + hb_timeout + 1;
+}
+
+static void hb_reset(void)
+{
+    unsigned long now = jiffies;
+    unsigned int i;
+    int cpu;
+
+    for (i = 0; i < hb_nslots; i++) {
+        for_each_possible_cpu(cpu)
+            per_cpu(hb_cpu_seen, cpu).seen[i] = now;
+        hb_slots[i].last_seen = now;
+        hb_slots[i].heard = now;
+        hb_slots[i].replay.top = 0;
+        hb_slots[i].replay.seen = 1;
+    }
+}
+
+/*
+ * Accept a counter at most once.
+ *
+ * Only called for packets whose tag already verified, so the lock is
+ * taken at the sender's rate and never for forged traffic.
+ */
+static bool hb_window_update(struct hb_window *w, u64 ctr)
+{
+    bool fresh = false;
+    u64 diff;
+
+    spin_lock(&w->lock);
+    if (ctr > w->top) {
+        diff = ctr - w->top;
+        w->seen = diff < HB_WINDOW ? (w->seen << diff) | 1 : 1;
+        w->top = ctr;
+        fresh = true;
     } else {
-        mod_timer(&hb_timer, jiffies + (unsigned long)heartbeat_interval * HZ);
+        diff = w->top - ctr;
+        if (diff < HB_WINDOW && !(w->seen & BIT_ULL(diff))) {
+            w->seen |= BIT_ULL(diff);
+            fresh = true;
+        }
     }
+    spin_unlock(&w->lock);
+
+    return fresh;
 }
 
 /*
- * Naive bounded substring search (O(n * m)).
+ * Read the destination address of a packet, IPv4 as IPv4-mapped. Only
+ * authenticated heartbeats need it, so the common path does not copy it.
+ */
+static bool hb_daddr(const struct sk_buff *skb, struct in6_addr *daddr)
+{
+    unsigned int noff = skb_network_offset(skb);
+
+    if (skb->protocol == htons(ETH_P_IP)) {
+        const __be32 *a;
+        __be32 _a;
+
+        a = skb_header_pointer(skb, noff + offsetof(struct iphdr, daddr),
+                               sizeof(_a), &_a);
+        if (!a)
+            return false;
+        ipv6_addr_set_v4mapped(*a, daddr);
+        return true;
+    }
+
+    return !skb_copy_bits(skb, noff + offsetof(struct ipv6hdr, daddr),
+                          daddr, sizeof(*daddr));
+}
+
+/*
+ * Verify an authenticated heartbeat.
  *
- * Payloads are typically short (MTU-bounded), so a hand-rolled search is sufficient.
- * This is kept intentionally simple, as more complex algorithms (KMP/BM)
- * would add branches and state with no measurable benefit in this use case.
+ * The message is copied to the stack only when it is not linear, and
+ * the tag is compared in constant time. Kept out of line so its cost
+ * can be profiled on its own (tests/bench_heartbeat.sh).
  */
-static void *k_memmem(const void *haystack, size_t haystack_len,
-                      const void *needle, size_t needle_len)
+static noinline bool hb_verify(const struct sk_buff *skb,
+                               const struct wb_pkt *pkt,
+                               struct hb_slot *slot)
 {
-    const u8 *h = haystack;
-    size_t i;
+    struct hb_mac_input in;
+    const struct hb_msg *msg;
+    struct hb_msg _msg;
+    __le64 tag;
+
+    if (pkt->payload_len != sizeof(_msg))
+        goto bad;
+
+    msg = skb_header_pointer(skb, pkt->payload_off, sizeof(_msg), &_msg);
+    if (!msg || memcmp(msg->magic, HB_MAGIC, sizeof(msg->magic)))
+        goto bad;
+
+    memcpy(in.magic, msg->magic, sizeof(in.magic));
+    in.counter = msg->counter;
+    in.saddr = pkt->saddr;
+    if (!hb_daddr(skb, &in.daddr))
+        goto bad;
+
+    tag = cpu_to_le64(siphash(&in, sizeof(in), &hb_key));
+    if (crypto_memneq(&tag, &msg->tag, sizeof(tag)))
+        goto bad;
+
+    if (!hb_window_update(&slot->replay, be64_to_cpu(msg->counter))) {
+        wb_count_inc(WB_CNT_NET_HB_REPLAY);
+        return false;
+    }
+    return true;
 
-    if (!needle_len || haystack_len < needle_len)
-        return NULL;
+bad:
+    wb_count_inc(WB_CNT_NET_HB_BAD);
+    return false;
+}
+
+/*
+ * Decide whether a packet from the heartbeat host counts as a heartbeat.
+ *
+ * Without heartbeat_port any packet does; with it only UDP to that port,
+ * and with heartbeat_key only a fresh message carrying a valid tag.
+ */
+static inline bool hb_accept(const struct sk_buff *skb, struct wb_pkt *pkt,
+                             int slot)
+{
+    if (!heartbeat_port)
+        return true;
 
-    for (i = 0; i <= haystack_len - needle_len; i++) {
-        if (!memcmp(h + i, needle, needle_len))
-            return (void *)(h + i);
+    if (pkt->l4proto != IPPROTO_UDP || !nf_parse_l4(skb, pkt) ||
+        pkt->dport != htons(heartbeat_port))
+        return false;
+
+    if (static_branch_unlikely(&nf_hb_auth_key))
+        return hb_verify(skb, pkt, &hb_slots[slot]);
+
+    return true;
+}
+
+/*
+ * Parse heartbeat_key: 32 hex digits, read as the two little-endian
+ * words of a SipHash key.
+ */
+static int hb_parse_key(const char *hex)
+{
+    __le64 raw[2];
+
+    if (strlen(hex) != 2 * sizeof(raw))
+        return -EINVAL;
+
+    if (hex2bin((u8 *)raw, hex, sizeof(raw))) {
+        memzero_explicit(raw, sizeof(raw));
+        return -EINVAL;
     }
-    return NULL;
+
+    hb_key.key[0] = le64_to_cpu(raw[0]);
+    hb_key.key[1] = le64_to_cpu(raw[1]);
+    memzero_explicit(raw, sizeof(raw));
+    return 0;
 }
 
 /*
- * Search a packet payload for the configured magic string.
+ * Point the timer at a jiffies deadline.
+ *
+ * The timer may fire anywhere within heartbeat_slack_ms after it, which
+ * lets an idle CPU serve it together with other wakeups.
+ */
+static void hb_set_expiry(unsigned long deadline, unsigned long now)
+{
+    ktime_t at = ktime_add_ns(ktime_get(), jiffies_to_nsecs(deadline - now));
+
+    hrtimer_set_expires_range_ns(&hb_timer, at, hb_slack);
+}
+
+/*
+ * Monitor heartbeat liveness.
  *
- * Payload inspection is independent of skb layout and safely spans
- * fragmented buffers.
+ * The timer only ever sits at the earliest moment the quorum could be
+ * lost. Heartbeats never touch it: when it fires and enough hosts were
+ * heard from in the meantime, it is pushed to the new deadline. Wakeups
+ * therefore follow the timeout rather than the number of hosts, packets
+ * or a polling interval. Expiry is never early and at most two ticks
+ * plus heartbeat_slack_ms late.
  */
-static bool payload_contains(const struct sk_buff *skb, size_t offset,
-                             size_t payload_size, const char *needle,
-                             size_t needle_len)
+static enum hrtimer_restart hb_timer_fn(struct hrtimer *t)
 {
-    u8 buf[PAYLOAD_SCAN_WIN];
-    size_t win = min_t(size_t, payload_size, PAYLOAD_SCAN_WIN);
-    size_t advance = win > needle_len ? win - needle_len + 1 : 1;
-    size_t pos;
+    unsigned long now = jiffies;
+    unsigned int alive;
+    unsigned long deadline = hb_deadline(now, &alive);
+
+    if (!time_before(now, deadline)) {
+        wb_info("heartbeat quorum lost (%u of %u hosts seen, %u required), scheduling exec\n",
+                alive, hb_nslots, hb_quorum);
+        wrong8007_activate(WB_SRC_HEARTBEAT, hrtimer_get_softexpires(t));
+        return HRTIMER_NORESTART;
+    }
+
+    hb_set_expiry(deadline, now);
+    return HRTIMER_RESTART;
+}
 
-    if (!needle_len || payload_size < needle_len)
+/*
+ * Search a packet payload for any of the wanted magic strings.
+ *
+ * The automaton is streamed over the linear area and page fragments in
+ * place, carrying its state across fragment boundaries, so every payload
+ * byte is looked at exactly once and nothing is copied. The textsearch
+ * algorithms walk the skb in place as well, one payload at a time.
+ */
+static bool payload_contains(struct sk_buff *skb, unsigned int offset,
+                             unsigned int payload_size, u32 want)
+{
+    struct skb_seq_state st;
+    unsigned int consumed = 0;
+    unsigned int len;
+    const u8 *data;
+    u16 state = 0;
+    unsigned int i;
+
+    if (!payload_size)
         return false;
 
-    for (pos = 0; pos + needle_len <= payload_size; pos += advance) {
-        size_t len = min(win, payload_size - pos);
+    wb_count_inc(WB_CNT_NET_PAYLOAD_SCANS);
 
-        if (skb_copy_bits(skb, offset + pos, buf, len))
-            return false;
+    if (static_branch_unlikely(&nf_textsearch_key)) {
+        for (i = 0; i < payload_count; i++) {
+            if (!(want & BIT(i)))
+                continue;
+            wb_count_add(WB_CNT_NET_PAYLOAD_BYTES, payload_size);
+            if (skb_find_text(skb, offset, offset + payload_size,
+                              payload_ts[i]) != UINT_MAX)
+                return true;
+        }
+        return false;
+    }
 
-        if (k_memmem(buf, len, needle, needle_len))
-            return true;
+    skb_prepare_seq_read(skb, offset, offset + payload_size, &st);
 
-        if (len < win)
-            break;
+    while ((len = skb_seq_read(consumed, &data, &st)) != 0) {
+        wb_count_add(WB_CNT_NET_PAYLOAD_BYTES, len);
+        if (wb_ac_feed(&payload_ac, &state, data, len, want)) {
+            skb_abort_seq_read(&st);
+            return true;
+        }
+        consumed += len;
     }
 
     return false;
 }
 
+/*
+ * Check the non-address conditions of a rule whose source prefix matched.
+ */
+static inline bool rule_match(const struct wb_net_rule *r,
+                              const struct wb_pkt *pkt, const u8 *src_mac,
+                              bool l4, bool port_hit)
+{
+    if (r->proto && r->proto != pkt->l4proto)
+        return false;
+
+    if ((r->flags & WB_RULE_L4) && !l4)
+        return false;
+
+    if ((r->flags & WB_RULE_MAC) &&
+        (!src_mac || !ether_addr_equal(r->mac, src_mac)))
+        return false;
+
+    if (r->flags & WB_RULE_PORT) {
+        u16 sport = ntohs(pkt->sport);
+        u16 dport = ntohs(pkt->dport);
+
+        if (!port_hit)
+            return false;
+
+        if ((sport < r->port_lo || sport > r->port_hi) &&
+            (dport < r->port_lo || dport > r->port_hi))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Look up the rules that apply to a packet's source address.
+ *
+ * The source is masked once per prefix length in use and looked up in
+ * the rule hash. Rules without a payload condition fire directly; the
+ * payload conditions of all other matching rules are collected and
+ * checked in a single pass over the payload.
+ */
+static void nf_match_rules(struct sk_buff *skb, struct wb_pkt *pkt,
+                           const struct wb_net_ruleset *rs)
+{
+    const u8 *src_mac = NULL;
+    bool l4 = false, port_hit = false;
+    u32 want = 0;
+    unsigned int i;
+
+    if (static_branch_unlikely(&nf_mac_key) &&
+        skb_mac_header_was_set(skb) && skb->mac_len >= ETH_HLEN)
+        src_mac = eth_hdr(skb)->h_source;
+
+    if (static_branch_unlikely(&nf_l4_key)) {
+        l4 = nf_parse_l4(skb, pkt);
+        if (l4)
+            port_hit = test_bit(ntohs(pkt->sport), rs->ports) ||
+                       test_bit(ntohs(pkt->dport), rs->ports);
+        else
+            wb_count_inc(WB_CNT_NET_L4_FAIL);
+    }
+
+    for (i = 0; i < rs->nprefixes; i++) {
+        const struct wb_net_rule *r;
+        u8 plen = rs->prefixes[i];
+        struct in6_addr key;
+
+        ipv6_addr_prefix(&key, &pkt->saddr, plen);
+
+        hlist_for_each_entry(r, wb_net_bucket(rs, &key, plen), node) {
+            if (r->prefix != plen || !ipv6_addr_equal(&r->addr, &key))
+                continue;
+
+            if (!rule_match(r, pkt, src_mac, l4, port_hit))
+                continue;
+
+            wb_count_inc(WB_CNT_NET_RULE_HIT);
+            if (!r->payloads) {
+                wb_info("network rule matched, scheduling exec\n");
+                wrong8007_activate(WB_SRC_NETWORK, ktime_get());
+                return;
+            }
+            want |= r->payloads;
+        }
+    }
+
+    if (want && payload_contains(skb, pkt->payload_off, pkt->payload_len, want)) {
+        wb_count_inc(WB_CNT_NET_PAYLOAD_HIT);
+        wb_info("magic payload matched, scheduling exec\n");
+        wrong8007_activate(WB_SRC_NETWORK, ktime_get());
+    }
+}
+
 /*
  * Evaluate incoming packets against the configured network triggers.
  *
- * Matching progresses from L2 through L4, allowing increasingly
- * specific trigger conditions while execution remains owned by
- * the core.
+ * Heartbeats are refreshed first; the packet is then checked against
+ * the compiled rule set, while execution remains owned by the core.
  */
 static unsigned int nf_hook_fn(void *priv,
                                 struct sk_buff *skb,
                                 const struct nf_hook_state *state)
 {
-    struct ethhdr *eth;
-    struct iphdr *iph;
-    struct tcphdr *tcph;
-    struct udphdr *udph;
-    unsigned int payload_size;
-    unsigned int iph_len;
-    size_t offset;
+    const struct wb_net_ruleset *rs;
+    struct wb_pkt pkt;
 
-    if (skb->protocol != htons(ETH_P_IP))
-        goto out;
+    wb_count_inc(WB_CNT_NET_PACKETS);
 
-    if (!pskb_may_pull(skb, sizeof(struct iphdr)))
+    if (!nf_is_ip(skb))
         goto out;
 
-    iph = ip_hdr(skb);
-
-    if (iph->ihl < 5)
+    if (!nf_parse_l3(skb, &pkt)) {
+        wb_count_inc(WB_CNT_NET_L3_FAIL);
         goto out;
+    }
 
-    iph_len = iph->ihl * 4;
+    if (wb_events_on() && READ_ONCE(event_packets))
+        wb_event_tag(WB_EV_PACKET, WB_SRC_NETWORK, skb->len, pkt.l4proto,
+                     &pkt.saddr, sizeof(pkt.saddr));
 
-    if (!pskb_may_pull(skb, iph_len))
-        goto out;
+    /* Refresh heartbeat liveness before evaluating trigger conditions */
+    if (static_branch_unlikely(&nf_heartbeat_key)) {
+        int slot = hb_lookup(&pkt.saddr);
 
-    iph = ip_hdr(skb);
+        if (slot >= 0 && hb_accept(skb, &pkt, slot)) {
+            wb_count_inc(WB_CNT_NET_HEARTBEAT);
+            hb_touch(slot);
+        }
+    }
 
-    /* Refresh heartbeat liveness before evaluating trigger conditions */
-    if (heartbeat_host && iph->saddr == heartbeat_ip_addr) {
-        unsigned long flags;
-        spin_lock_irqsave(&hb_lock, flags);
-        last_seen_jiffies = jiffies;
-        spin_unlock_irqrestore(&hb_lock, flags);
+    if (static_branch_unlikely(&nf_rules_key)) {
+        rs = rcu_dereference(active_rules);
+        if (rs)
+            nf_match_rules(skb, &pkt, rs);
     }
 
-    if (match_mac) {
-        if (!skb_mac_header_was_set(skb) || skb->mac_len < ETH_HLEN)
-            goto out;
+out:
+    return NF_ACCEPT;
+}
 
-        if (!pskb_may_pull(skb, ETH_HLEN))
-            goto out;
+static void payload_free(void)
+{
+    unsigned int i;
 
-        iph = ip_hdr(skb);
-        eth = eth_hdr(skb);
-        if (!ether_addr_equal(mac_bytes, eth->h_source))
-            goto out;
+    for (i = 0; i < ARRAY_SIZE(payload_ts); i++) {
+        if (payload_ts[i])
+            textsearch_destroy(payload_ts[i]);
+        payload_ts[i] = NULL;
     }
+    wb_ac_free(&payload_ac);
+    payload_count = 0;
+}
 
-    if (match_ip && iph->saddr != match_ip_addr)
-        goto out;
+/*
+ * Compile the configured magic payloads for the selected algorithm.
+ *
+ * "ac" builds one automaton covering every payload. "kmp" and "bm" use
+ * the kernel textsearch implementations, one configuration per payload;
+ * Boyer-Moore can skip ahead on long payloads.
+ *
+ * Returns the number of compiled patterns or a negative errno.
+ */
+static int payload_compile(void)
+{
+    const u8 *patterns[MAX_PAYLOADS];
+    size_t lens[MAX_PAYLOADS];
+    unsigned int n = 0;
+    unsigned int i;
+    int ret;
 
-    if (match_port || match_payload) {
+    if (strcmp(payload_algo, "ac") && strcmp(payload_algo, "kmp") &&
+        strcmp(payload_algo, "bm")) {
+        wb_err("unknown payload_algo '%s' (ac|kmp|bm)\n", payload_algo);
+        return -EINVAL;
+    }
 
-        if (iph->protocol == IPPROTO_TCP) {
-            if (!pskb_may_pull(skb, iph_len + sizeof(struct tcphdr)))
-                goto out;
+    for (i = 0; i < match_payload_count; i++) {
+        size_t len = match_payload[i] ? strlen(match_payload[i]) : 0;
 
-            iph = ip_hdr(skb);
-            tcph = (struct tcphdr *)((u8 *)iph + iph_len);
+        payload_bit[i] = 0;
+        if (!len) {
+            wb_warn("empty payload string, ignoring payload match\n");
+            continue;
+        }
 
-            if (tcph->doff < 5)
-                goto out;
+        payload_bit[i] = BIT(n);
+        patterns[n] = (const u8 *)match_payload[i];
+        lens[n++] = len;
+    }
 
-            if (!pskb_may_pull(skb, iph_len + tcph->doff * 4))
-                goto out;
+    if (!n)
+        return 0;
 
-            iph = ip_hdr(skb);
-            tcph = (struct tcphdr *)((u8 *)iph + iph_len);
+    if (!strcmp(payload_algo, "ac")) {
+        ret = wb_ac_build(&payload_ac, patterns, lens, n);
+        if (ret) {
+            wb_err("failed to compile payload patterns (err=%d)\n", ret);
+            return ret;
+        }
+        return n;
+    }
 
-            if (match_port &&
-                ntohs(tcph->source) != match_port &&
-                ntohs(tcph->dest) != match_port)
-                goto out;
+    for (i = 0; i < n; i++) {
+        struct ts_config *conf;
 
-            offset = skb_offset(skb, (u8 *)tcph + tcph->doff * 4);
-            if (offset > skb->len)
-                goto out;
-            payload_size = skb->len - offset;
+        conf = textsearch_prepare(payload_algo, patterns[i], lens[i],
+                                  GFP_KERNEL, TS_AUTOLOAD);
+        if (IS_ERR(conf)) {
+            wb_err("failed to prepare %s textsearch (err=%ld)\n",
+                payload_algo, PTR_ERR(conf));
+            payload_free();
+            return PTR_ERR(conf);
+        }
+        payload_ts[i] = conf;
+    }
 
-        } else if (iph->protocol == IPPROTO_UDP) {
-            if (!pskb_may_pull(skb, iph_len + sizeof(struct udphdr)))
-                goto out;
+    return n;
+}
 
-            iph = ip_hdr(skb);
-            udph = (struct udphdr *)((u8 *)iph + iph_len);
+#ifdef CONFIG_NETFILTER_INGRESS
+/*
+ * Detach the ingress hook of a single interface. Caller holds RTNL.
+ */
+static void ingress_unhook(int i)
+{
+    nf_unregister_net_hook(dev_net(ingress_netdev[i]), &ingress_ops[i]);
+    dev_put(ingress_netdev[i]);
+    ingress_netdev[i] = NULL;
+}
 
-            if (ntohs(udph->len) < sizeof(struct udphdr))
-                goto out;
+/*
+ * Release the hook of an interface that is going away, so that its
+ * unregistration is never held up by our device reference.
+ */
+static int ingress_netdev_event(struct notifier_block *nb,
+                                unsigned long event, void *ptr)
+{
+    struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+    int i;
 
-            if (match_port &&
-                ntohs(udph->source) != match_port &&
-                ntohs(udph->dest) != match_port)
-                goto out;
+    if (event != NETDEV_UNREGISTER)
+        return NOTIFY_DONE;
 
-            if (!pskb_may_pull(skb, iph_len + ntohs(udph->len)))
-                goto out;
+    for (i = 0; i < ingress_dev_count; i++) {
+        if (ingress_netdev[i] == dev) {
+            wb_warn("ingress device %s unregistered, hook detached\n",
+                dev->name);
+            ingress_unhook(i);
+        }
+    }
 
-            iph = ip_hdr(skb);
-            udph = (struct udphdr *)((u8 *)iph + iph_len);
+    return NOTIFY_DONE;
+}
 
-            offset = skb_offset(skb, (u8 *)udph + sizeof(struct udphdr));
-            if (offset > skb->len)
-                goto out;
+static struct notifier_block ingress_nb = {
+    .notifier_call = ingress_netdev_event,
+};
 
-            payload_size = ntohs(udph->len) - sizeof(struct udphdr);
-        } else {
-            goto out;
+/*
+ * Attach the packet hook at netdev ingress on each configured interface.
+ *
+ * Ingress hooks run before the IP stack and only for the selected
+ * interfaces, so traffic on other interfaces never reaches nf_hook_fn.
+ */
+static int ingress_register(void)
+{
+    int i, ret;
+
+    ret = register_netdevice_notifier(&ingress_nb);
+    if (ret)
+        return ret;
+
+    rtnl_lock();
+    for (i = 0; i < ingress_dev_count; i++) {
+        struct net_device *dev;
+
+        dev = __dev_get_by_name(&init_net, ingress_dev[i]);
+        if (!dev) {
+            wb_err("ingress device '%s' not found\n", ingress_dev[i]);
+            ret = -ENODEV;
+            goto err;
         }
 
-        if (match_payload &&
-            payload_contains(skb, offset, payload_size, match_payload, payload_len)) {
-            wb_info("magic payload matched, scheduling exec\n");
-            wrong8007_activate();
+        ingress_ops[i].hook = nf_hook_fn;
+        ingress_ops[i].pf = NFPROTO_NETDEV;
+        ingress_ops[i].hooknum = NF_NETDEV_INGRESS;
+        ingress_ops[i].priority = INT_MIN;
+        ingress_ops[i].dev = dev;
+
+        ret = nf_register_net_hook(dev_net(dev), &ingress_ops[i]);
+        if (ret) {
+            wb_err("failed to register ingress hook on %s: %d\n",
+                dev->name, ret);
+            goto err;
         }
 
-    } else if (match_mac || match_ip) {
-        /* Trigger on L2/L3 match alone */
-        wb_info("MAC/IP trigger matched, scheduling exec\n");
-        wrong8007_activate();
+        dev_hold(dev);
+        ingress_netdev[i] = dev;
     }
+    rtnl_unlock();
 
-out:
-    return NF_ACCEPT;
+    return 0;
+
+err:
+    while (--i >= 0) {
+        if (ingress_netdev[i])
+            ingress_unhook(i);
+    }
+    rtnl_unlock();
+    unregister_netdevice_notifier(&ingress_nb);
+    return ret;
 }
 
-static int trigger_network_init(void)
+static void ingress_unregister(void)
 {
-    int ret;
+    int i;
+
+    unregister_netdevice_notifier(&ingress_nb);
+
+    rtnl_lock();
+    for (i = 0; i < ingress_dev_count; i++) {
+        if (ingress_netdev[i])
+            ingress_unhook(i);
+    }
+    rtnl_unlock();
+}
+#else
+static int ingress_register(void)
+{
+    wb_err("ingress_dev requires CONFIG_NETFILTER_INGRESS\n");
+    return -EOPNOTSUPP;
+}
+
+static void ingress_unregister(void)
+{
+}
+#endif
+
+/*
+ * Attach nf_hook_fn either at IPv4/IPv6 PRE_ROUTING or at ingress of the
+ * configured interfaces.
+ */
+static int nf_hooks_register(void)
+{
+    if (ingress_dev_count)
+        return ingress_register();
+
+    nfho[0].hook = nf_hook_fn;
+    nfho[0].hooknum = NF_INET_PRE_ROUTING;
+    nfho[0].pf = NFPROTO_IPV4;
+    nfho[0].priority = NF_IP_PRI_FIRST;
+
+    nfho[1].hook = nf_hook_fn;
+    nfho[1].hooknum = NF_INET_PRE_ROUTING;
+    nfho[1].pf = NFPROTO_IPV6;
+    nfho[1].priority = NF_IP6_PRI_FIRST;
+
+    return nf_register_net_hooks(&init_net, nfho, NF_HOOK_COUNT);
+}
+
+static void nf_hooks_unregister(void)
+{
+    if (ingress_dev_count)
+        ingress_unregister();
+    else
+        nf_unregister_net_hooks(&init_net, nfho, NF_HOOK_COUNT);
+}
+
+/*
+ * Translate the match_payload indices of a rule into pattern bits.
+ */
+static int rule_bind_payloads(struct wb_net_rule *r)
+{
+    u32 bits = 0;
+    unsigned int i;
+
+    for (i = 0; i < MAX_PAYLOADS; i++) {
+        if (!(r->payloads & BIT(i)))
+            continue;
+        if (i >= match_payload_count || !payload_bit[i])
+            return -EINVAL;
+        bits |= payload_bit[i];
+    }
+
+    r->payloads = bits;
+    return 0;
+}
+
+/*
+ * Express the single-condition parameters as one rule.
+ *
+ * match_port without a payload never fired on its own, so it still does
+ * not produce a rule. Returns 1 if a rule was built, 0 if none is
+ * configured, or a negative errno.
+ */
+static int legacy_rule(struct wb_net_rule *r)
+{
+    memset(r, 0, sizeof(*r));
+
+    if (match_port < 0 || match_port > U16_MAX) {
+        wb_err("invalid port: %d\n", match_port);
+        return -EINVAL;
+    }
 
     if (match_mac) {
-        if (!parse_mac(match_mac, mac_bytes)) {
+        if (!wb_parse_mac(match_mac, r->mac)) {
             wb_err("invalid MAC format: '%s'\n", match_mac);
             return -EINVAL;
         }
+        r->flags |= WB_RULE_MAC;
     }
     if (match_ip) {
-        if (!wb_parse_ipv4(match_ip, &match_ip_addr)) {
+        if (!wb_parse_inet(match_ip, &r->addr)) {
             wb_err("invalid IP format\n");
             return -EINVAL;
         }
+        r->prefix = 128;
     }
-    if (match_payload) {
-        payload_len = strlen(match_payload);
-        if (payload_len == 0) {
-            wb_warn("empty payload string, ignoring payload match\n");
-            match_payload = NULL;
-            payload_len = 0;
-        } else if (payload_len > PAYLOAD_SCAN_WIN) {
-            wb_err("payload string too long (max %d bytes)\n",
-                PAYLOAD_SCAN_WIN);
-            return -EINVAL;
+
+    if (match_port && !payload_count) {
+        wb_warn("match_port without match_payload never fires, ignoring\n");
+        return 0;
+    }
+
+    if (payload_count) {
+        r->payloads = GENMASK(payload_count - 1, 0);
+        r->flags |= WB_RULE_L4;
+        if (match_port) {
+            r->port_lo = r->port_hi = match_port;
+            r->flags |= WB_RULE_PORT;
+        }
+    }
+
+    return r->flags || r->prefix;
+}
+
+/*
+ * Compile a rule list, or the single-condition parameters when the list
+ * is empty, into a rule set. *out is NULL if nothing is configured.
+ */
+static int net_rules_compile(const char *spec, struct wb_net_ruleset **out)
+{
+    struct wb_net_rule legacy;
+    struct wb_net_rule *rules;
+    unsigned int count, i;
+    int ret;
+
+    *out = NULL;
+
+    if (!spec || !*spec) {
+        ret = legacy_rule(&legacy);
+        if (ret <= 0)
+            return ret;
+
+        *out = wb_net_ruleset_build(&legacy, 1);
+        return *out ? 0 : -ENOMEM;
+    }
+
+    ret = wb_net_rules_parse(spec, &rules, &count);
+    if (ret)
+        return ret;
+
+    for (i = 0; i < count; i++) {
+        ret = rule_bind_payloads(&rules[i]);
+        if (ret) {
+            wb_err("network rule #%u references an unknown payload\n", i);
+            goto out;
+        }
+    }
+
+    if (count) {
+        *out = wb_net_ruleset_build(rules, count);
+        if (!*out)
+            ret = -ENOMEM;
+    }
+
+out:
+    kvfree(rules);
+    return ret;
+}
+
+/*
+ * Make a rule set the active one.
+ *
+ * Stages the new rules need are patched in before they become visible,
+ * and stages only the old rules needed are patched out once no packet
+ * can still be looking at them, so a swap never drops a condition.
+ */
+static void net_rules_publish(struct wb_net_ruleset *rs)
+{
+    struct wb_net_ruleset *old = rcu_dereference_protected(active_rules, 1);
+    u8 need = rs ? rs->need : 0;
+
+    if (rs)
+        static_branch_enable(&nf_rules_key);
+    if (need & WB_RULE_MAC)
+        static_branch_enable(&nf_mac_key);
+    if (need & WB_RULE_L4)
+        static_branch_enable(&nf_l4_key);
+
+    rcu_assign_pointer(active_rules, rs);
+
+    if (!old)
+        return;
+
+    synchronize_rcu();
+
+    if (!(need & WB_RULE_MAC))
+        static_branch_disable(&nf_mac_key);
+    if (!(need & WB_RULE_L4))
+        static_branch_disable(&nf_l4_key);
+    if (!rs)
+        static_branch_disable(&nf_rules_key);
+
+    wb_net_ruleset_free(old);
+}
+
+/*
+ * Runtime net_rules update. The new rules are compiled here, in process
+ * context, and only swapped in once complete. A write that leaves no
+ * rule at all would disarm the trigger and is refused; an empty value
+ * falls back to the match_* parameters if those form a rule.
+ */
+static int net_rules_apply(const char *val)
+{
+    struct wb_net_ruleset *rs;
+    int ret;
+
+    if (!net_live)
+        return 0; // picked up by init
+
+    ret = net_rules_compile(val, &rs);
+    if (ret)
+        return ret;
+
+    if (!rs) {
+        wb_err("refusing to clear network rules at runtime\n");
+        return -EINVAL;
+    }
+
+    net_rules_publish(rs);
+
+    if (!hook_registered) {
+        ret = nf_hooks_register();
+        if (ret) {
+            wb_err("failed to register net hook: %d\n", ret);
+            net_rules_publish(NULL);
+            return ret;
         }
+        hook_registered = true;
     }
 
-    if (!match_mac && !match_ip && !match_port && !match_payload && !heartbeat_host) {
+    wb_info("network rules updated (%u rules)\n", rs->count);
+    return 0;
+}
+
+static int network_setup(void)
+{
+    struct wb_net_ruleset *rs;
+    int ret;
+
+    ret = payload_compile();
+    if (ret < 0)
+        return ret;
+    payload_count = ret;
+
+    if (net_rules && *net_rules && (match_mac || match_ip || match_port)) {
+        wb_err("match_mac/match_ip/match_port cannot be combined with net_rules\n");
+        ret = -EINVAL;
+        goto err_payload;
+    }
+
+    if ((heartbeat_key || heartbeat_port || heartbeat_quorum) &&
+        !heartbeat_host_count) {
+        wb_err("heartbeat_key/heartbeat_port/heartbeat_quorum require heartbeat_host\n");
+        ret = -EINVAL;
+        goto err_payload;
+    }
+
+    ret = net_rules_compile(net_rules, &rs);
+    if (ret)
+        goto err_payload;
+
+    /* Payloads stay compiled so that rules can still be added at runtime */
+    if (!rs && !heartbeat_host_count) {
         wb_warn("network trigger disabled (no network parameters)\n");
         return 0; // success, no hook
     }
 
+    net_rules_publish(rs);
+
     /* Initialize heartbeat monitoring */
-    if (heartbeat_host) {
-        if (!wb_parse_ipv4(heartbeat_host, &heartbeat_ip_addr)) {
-            wb_err("invalid heartbeat host IP\n");
-            return -EINVAL;
+    if (heartbeat_host_count) {
+        unsigned long now;
+        int i;
+
+        hb_nslots = 0;
+        memset(hb_hash, 0, sizeof(hb_hash));
+        for (i = 0; i < heartbeat_host_count; i++) {
+            ret = hb_add_host(heartbeat_host[i]);
+            if (ret) {
+                wb_err("%s heartbeat host: %s\n",
+                       ret == -EEXIST ? "duplicate" : "invalid", heartbeat_host[i]);
+                ret = -EINVAL;
+                goto err_rules;
+            }
         }
-        if (heartbeat_interval < 1) {
-            wb_err("heartbeat_interval must be >= 1 second\n");
-            return -EINVAL;
+
+        ret = -EINVAL;
+        if (heartbeat_quorum > hb_nslots) {
+            wb_err("heartbeat_quorum exceeds the number of heartbeat hosts\n");
+            goto err_rules;
         }
-        if (heartbeat_timeout <= heartbeat_interval) {
-            wb_err("heartbeat_timeout must be greater than heartbeat_interval\n");
-            return -EINVAL;
+        hb_quorum = heartbeat_quorum ?: hb_nslots;
+        if (heartbeat_interval)
+            wb_warn("heartbeat_interval is deprecated and ignored\n");
+        if (heartbeat_timeout_ms) {
+            hb_timeout = msecs_to_jiffies(heartbeat_timeout_ms);
+        } else if (heartbeat_timeout) {
+            hb_timeout = heartbeat_timeout < MAX_JIFFY_OFFSET / HZ ?
+                (unsigned long)heartbeat_timeout * HZ : MAX_JIFFY_OFFSET;
+        } else {
+            wb_err("heartbeat timeout must not be 0\n");
+            goto err_rules;
         }
-        if (heartbeat_interval > ULONG_MAX / HZ || heartbeat_timeout > ULONG_MAX / HZ) {
-            wb_err("heartbeat interval/timeout too large\n");
-            return -EINVAL;
+        if (hb_timeout >= MAX_JIFFY_OFFSET) {
+            wb_err("heartbeat timeout too large\n");
+            goto err_rules;
+        }
+        hb_slack = (u64)heartbeat_slack_ms * NSEC_PER_MSEC;
+        hb_gap = heartbeat_gap_ms ? msecs_to_jiffies(heartbeat_gap_ms) :
+                                    hb_timeout / 2;
+        if (heartbeat_port > U16_MAX) {
+            wb_err("invalid heartbeat_port\n");
+            goto err_rules;
         }
-        unsigned long flags;
-        spin_lock_irqsave(&hb_lock, flags);
-        last_seen_jiffies = jiffies;
-        spin_unlock_irqrestore(&hb_lock, flags);
-        timer_setup(&hb_timer, hb_timer_fn, 0);
-        mod_timer(&hb_timer, jiffies + (unsigned long)heartbeat_interval * HZ);
+        if (heartbeat_key) {
+            if (!heartbeat_port) {
+                wb_err("heartbeat_key requires heartbeat_port\n");
+                goto err_rules;
+            }
+            if (hb_parse_key(heartbeat_key)) {
+                wb_err("heartbeat_key must be 32 hex digits\n");
+                goto err_rules;
+            }
+            /* The parameter copy is never needed again */
+            memzero_explicit(heartbeat_key, strlen(heartbeat_key));
+        }
+        hb_reset();
+        wb_hrtimer_setup(&hb_timer, hb_timer_fn, CLOCK_MONOTONIC,
+                         HRTIMER_MODE_ABS_SOFT);
+        now = jiffies;
+        hb_set_expiry(now + hb_timeout + 1, now);
+        hrtimer_start_expires(&hb_timer, HRTIMER_MODE_ABS_SOFT);
     }
 
-    /* Activate packet inspection */
-    nfho.hook = nf_hook_fn;
-    nfho.hooknum = NF_INET_PRE_ROUTING;
-    nfho.pf = PF_INET;
-    nfho.priority = NF_IP_PRI_FIRST;
+    /* Compile configured conditions before the hook can observe them */
+    nf_keys_enable();
 
-    ret = nf_register_net_hook(&init_net, &nfho);
+    /* Activate packet inspection */
+    ret = nf_hooks_register();
     if (ret) {
         wb_err("failed to register net hook: %d\n", ret);
-        if (heartbeat_host)
-            wb_timer_delete_sync(&hb_timer);
-        return ret;
+        goto err_hook;
     }
 
     hook_registered = true;
-    wb_info("network trigger initialized\n");
+    wb_info("network trigger initialized (%u rules)\n", rs ? rs->count : 0);
     return 0;
+
+err_hook:
+    if (heartbeat_host_count)
+        hrtimer_cancel(&hb_timer);
+    nf_keys_disable();
+err_rules:
+    net_rules_publish(NULL);
+err_payload:
+    payload_free();
+    return ret;
+}
+
+static int trigger_network_init(void)
+{
+    int ret;
+
+    kernel_param_lock(THIS_MODULE);
+    ret = network_setup();
+    net_live = !ret;
+    kernel_param_unlock(THIS_MODULE);
+
+    return ret;
 }
 
 static void trigger_network_exit(void)
 {
+    kernel_param_lock(THIS_MODULE);
+    net_live = false;
+    kernel_param_unlock(THIS_MODULE);
+
     if (hook_registered) {
-        nf_unregister_net_hook(&init_net, &nfho);
+        nf_hooks_unregister();
         hook_registered = false;
     }
-    if (heartbeat_host)
-        wb_timer_delete_sync(&hb_timer);
+    if (heartbeat_host_count)
+        hrtimer_cancel(&hb_timer);
+    net_rules_publish(NULL);
+    nf_keys_disable();
+    payload_free();
+    memzero_explicit(&hb_key, sizeof(hb_key));
     wb_info("network trigger exited\n");
 }
 
@@ -410,20 +1471,50 @@ struct wrong8007_trigger network_trigger = {
 MODULE_PARM_DESC(match_mac, "MAC address to match");
 module_param(match_mac, charp, 0000);
 
-MODULE_PARM_DESC(match_ip, "IPv4 address to match");
+MODULE_PARM_DESC(match_ip, "IPv4 or IPv6 address to match");
 module_param(match_ip, charp, 0000);
 
 MODULE_PARM_DESC(match_port, "TCP/UDP port to match");
 module_param(match_port, int, 0000);
 
-MODULE_PARM_DESC(match_payload, "magic payload string");
-module_param(match_payload, charp, 0000);
+MODULE_PARM_DESC(match_payload, "magic payload strings (comma-separated)");
+module_param_array(match_payload, charp, &match_payload_count, 0000);
+
+MODULE_PARM_DESC(net_rules, "network rules: 'key=value,...;...' (mac, ip[/len], port[-hi], proto, payload), writable at runtime (one page per write)");
+module_param_cb(net_rules, &wb_param_ops_reload, &net_rules_param, 0600);
+
+MODULE_PARM_DESC(payload_algo, "payload search algorithm: ac (default), kmp or bm");
+module_param(payload_algo, charp, 0000);
+
+MODULE_PARM_DESC(ingress_dev, "interfaces to hook at ingress instead of PRE_ROUTING (comma-separated)");
+module_param_array(ingress_dev, charp, &ingress_dev_count, 0000);
+
+MODULE_PARM_DESC(heartbeat_host, "IPv4 or IPv6 addresses for heartbeat monitoring (comma-separated)");
+module_param_array(heartbeat_host, charp, &heartbeat_host_count, 0000);
 
-MODULE_PARM_DESC(heartbeat_host, "IPv4 address for heartbeat monitoring");
-module_param(heartbeat_host, charp, 0000);
+MODULE_PARM_DESC(heartbeat_quorum, "fire when fewer than this many heartbeat hosts were seen within the timeout (default: all)");
+module_param(heartbeat_quorum, uint, 0000);
 
-MODULE_PARM_DESC(heartbeat_interval, "heartbeat check interval (seconds)");
+MODULE_PARM_DESC(heartbeat_interval, "deprecated and ignored; expiry follows heartbeat_timeout exactly");
 module_param(heartbeat_interval, uint, 0000);
 
 MODULE_PARM_DESC(heartbeat_timeout, "heartbeat timeout before trigger (seconds)");
 module_param(heartbeat_timeout, uint, 0000);
+
+MODULE_PARM_DESC(heartbeat_timeout_ms, "heartbeat timeout in milliseconds; overrides heartbeat_timeout");
+module_param(heartbeat_timeout_ms, uint, 0000);
+
+MODULE_PARM_DESC(heartbeat_slack_ms, "how late the expiry timer may fire, so wakeups can be batched (default: 0)");
+module_param(heartbeat_slack_ms, uint, 0000);
+
+MODULE_PARM_DESC(heartbeat_gap_ms, "report heartbeat gaps longer than this on /dev/wrong8007 (default: half the timeout)");
+module_param(heartbeat_gap_ms, uint, 0000);
+
+MODULE_PARM_DESC(heartbeat_port, "only count UDP packets to this port as heartbeats");
+module_param(heartbeat_port, uint, 0000);
+
+MODULE_PARM_DESC(heartbeat_key, "SipHash key (32 hex digits); heartbeats must carry a valid tag");
+module_param(heartbeat_key, charp, 0000);
+
+MODULE_PARM_DESC(event_packets, "emit a /dev/wrong8007 event for every inspected packet (debug), writable at runtime");
+module_param(event_packets, bool, 0600);
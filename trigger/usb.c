@@ -7,120 +7,214 @@
 
 #include <linux/usb.h>
 #include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/rcupdate.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 #include <wrong8007.h>
+#include <stats.h>
+#include <usb_rules.h>
 
-#define MAX_USB_DEVICES 16
+/*
+ * Compiled rule set, replaced as a whole when usb_devices is rewritten
+ * at runtime and read by the notifier under RCU.
+ */
+static struct wb_usb_ruleset __rcu *usb_rules;
+
+/*
+ * Pending USB events. Each CPU's ring has the notifier running on that
+ * CPU as its only producer and the batch worker as its only consumer.
+ */
+#define USB_RING 32
+#define USB_DEBOUNCE_MAX_MS 10000
 
-// Device rule structure
-struct usb_dev_rule {
-    u16 vid;
-    u16 pid;
-    enum { USB_EVT_INSERT, USB_EVT_EJECT, USB_EVT_ANY } event;
+struct usb_event {
+    struct wb_usb_id id;
+    u64 ts;
+    u8 event;
 };
 
-// Table of valid USB events and their enum values
-static const struct {
-    const char *name;
-    int value;
-} evt_map[] = {
-    { "insert", USB_EVT_INSERT },
-    { "eject",  USB_EVT_EJECT  },
-    { "any",    USB_EVT_ANY    },
+struct usb_ring {
+    unsigned int head;
+    unsigned int tail;
+    struct usb_event ev[USB_RING];
 };
 
-// Storage for parsed rules
-static struct usb_dev_rule usb_rules[MAX_USB_DEVICES];
-static int usb_rule_count;
+static struct usb_ring __percpu *usb_rings;
+
+// Trigger state, protected by the module parameter lock
+static bool usb_live;
+static bool usb_registered;
 
 // Whitelist/blacklist mode (default = blacklist)
 static bool usb_whitelist = false;
 module_param_named(whitelist, usb_whitelist, bool, 0000);
 MODULE_PARM_DESC(whitelist, "true=match all except listed, false=only match listed devices");
 
-// Device rules as strings: "VID:PID:EVENT"
-static char *usb_devices[MAX_USB_DEVICES];
-static int usb_devices_count;
-module_param_array(usb_devices, charp, &usb_devices_count, 0000);
-MODULE_PARM_DESC(usb_devices, "VID:PID:EVENT (EVENT=insert|eject|any)");
+// Extra time to collect a burst of events before matching them
+static unsigned int usb_debounce_ms;
+module_param(usb_debounce_ms, uint, 0600);
+MODULE_PARM_DESC(usb_debounce_ms, "delay USB rule matching to batch event bursts (ms, default 0, max 10000)");
+
+// Set by the session's screen locker; gates rules marked "locked"
+static bool host_locked;
+module_param(host_locked, bool, 0600);
+MODULE_PARM_DESC(host_locked, "host is locked (set from the screen locker), enables 'locked' USB rules");
+
+// Device rules as a string: "VID:PID[:EVENT][:COND...],..."
+static char *usb_devices;
+
+static int usb_devices_apply(const char *val);
+
+static struct wb_param_reload usb_devices_param = {
+    .str = &usb_devices,
+    .apply = usb_devices_apply,
+};
+
+module_param_cb(usb_devices, &wb_param_ops_reload, &usb_devices_param, 0600);
+MODULE_PARM_DESC(usb_devices, "VID:PID[:EVENT][:class=CC][:serial=S][:mfr=S][:locked][:path=BUS-PORT.PORT],... (PID may be '*', EVENT=insert|eject|any), writable at runtime (one page per write)");
 
-// Parse module param usb_devices[] into structured rules
-static int parse_usb_devices(void)
+/*
+ * Collect the device class and the class of every interface in every
+ * configuration. The configuration descriptors are read by the USB core
+ * before the device is announced and stay valid until it is released,
+ * so this works for both insertion and removal and does not depend on
+ * which configuration ends up active.
+ */
+static void usb_collect_classes(const struct usb_device *udev, unsigned long *classes)
 {
-    int i, j;
-
-    for (i = 0; i < usb_devices_count; i++) {
-        unsigned int vid, pid;
-        char buf[64];         // local bounded copy of param string
-        char evt_str[16] = "any"; // default: "any", can be "eject" or "insert"
-        int n;
-
-        // Skip NULL or empty entries (unlikely but possible)
-        if (!usb_devices[i] || !*usb_devices[i]) {
-            wb_warn("skipping empty USB rule at index %d\n", i);
-            continue;
-        }
+    unsigned int c, i, a;
 
-        // Ensure bounded copy of the module param string
-        strscpy(buf, usb_devices[i], sizeof(buf));
+    bitmap_zero(classes, WB_USB_CLASSES);
 
-        n = sscanf(buf, "%x:%x:%15s", &vid, &pid, evt_str);
-        if (n < 2) {
-            wb_err("invalid USB rule '%s'\n", buf);
-            return -EINVAL;
-        }
+    // Class 0 means "defined per interface"
+    if (udev->descriptor.bDeviceClass)
+        __set_bit(udev->descriptor.bDeviceClass, classes);
 
-        if (vid > 0xffff || pid > 0xffff) {
-            wb_err("VID/PID out of range (max 0xffff) in rule '%s'\n", buf);
-            return -EINVAL;
-        }
+    if (!udev->config)
+        return;
 
-        usb_rules[usb_rule_count].vid = (u16)vid;
-        usb_rules[usb_rule_count].pid = (u16)pid;
+    for (c = 0; c < udev->descriptor.bNumConfigurations; c++) {
+        const struct usb_host_config *cfg = &udev->config[c];
 
-        // Map event string to enum
-        for (j = 0; j < ARRAY_SIZE(evt_map); j++) {
-            if (!strcmp(evt_str, evt_map[j].name)) {
-                usb_rules[usb_rule_count].event = evt_map[j].value;
-                goto valid_event;
-            }
+        for (i = 0; i < cfg->desc.bNumInterfaces && i < USB_MAXINTERFACES; i++) {
+            const struct usb_interface_cache *intf = cfg->intf_cache[i];
+
+            if (!intf)
+                continue;
+            for (a = 0; a < intf->num_altsetting; a++)
+                __set_bit(intf->altsetting[a].desc.bInterfaceClass, classes);
         }
+    }
+}
 
-        wb_err("unknown event '%s' in rule '%s'\n", evt_str, buf);
-        return -EINVAL;
+/*
+ * Match one event and fire if the rules say so. Runs from the batch
+ * worker, or from the notifier itself when its ring is full.
+ */
+static bool usb_evaluate(const struct usb_event *ev)
+{
+    const struct wb_usb_ruleset *rs;
+    bool fire = false;
 
-valid_event:
-        wb_dbg("rule[%d] VID=0x%04x PID=0x%04x EVENT=%s\n",
-                usb_rule_count, vid, pid, evt_str);
-        usb_rule_count++;
+    /*
+     * Port path rules fire on their own; the device tables decide
+     * according to the whitelist/blacklist mode.
+     */
+    rcu_read_lock();
+    rs = rcu_dereference(usb_rules);
+    if (rs) {
+        fire = wb_usb_paths_match(rs, &ev->id, ev->event);
+        if (!fire && rs->kinds)
+            fire = usb_whitelist != wb_usb_rules_match(rs, &ev->id, ev->event);
     }
+    rcu_read_unlock();
 
-    return 0;
+    if (!fire)
+        return false;
+
+    wb_count_inc(WB_CNT_USB_HIT);
+    wb_info("USB trigger fired (VID=0x%04x PID=0x%04x, %lluus after the event)\n",
+            ev->id.vid, ev->id.pid, div_u64(ktime_get_ns() - ev->ts, NSEC_PER_USEC));
+    wrong8007_activate(WB_SRC_USB, ns_to_ktime(ev->ts));
+    return true;
 }
 
-// Match a device/action against rules
-static bool match_rules(u16 vid, u16 pid, unsigned long action)
+static bool usb_event_same(const struct usb_event *a, const struct usb_event *b)
 {
-    int i;
-    for (i = 0; i < usb_rule_count; i++) {
-        if (vid == usb_rules[i].vid && pid == usb_rules[i].pid) {
-            if ((action == USB_DEVICE_ADD &&
-                 (usb_rules[i].event == USB_EVT_INSERT || usb_rules[i].event == USB_EVT_ANY)) ||
-                (action == USB_DEVICE_REMOVE &&
-                 (usb_rules[i].event == USB_EVT_EJECT || usb_rules[i].event == USB_EVT_ANY)))
-                return true;
+    return a->event == b->event && !memcmp(&a->id, &b->id, sizeof(a->id));
+}
+
+/*
+ * Drain every CPU's ring. Repeats of the event just evaluated, as sent
+ * by a device bouncing on a flaky port, are counted and skipped, and
+ * nothing is evaluated once the trigger has fired.
+ */
+static void usb_batch_fn(struct work_struct *work)
+{
+    bool fired = false;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct usb_ring *ring = per_cpu_ptr(usb_rings, cpu);
+        unsigned int tail = ring->tail;
+        unsigned int head = smp_load_acquire(&ring->head);
+        const struct usb_event *prev = NULL;
+
+        for (; tail != head; tail++) {
+            const struct usb_event *ev = &ring->ev[tail & (USB_RING - 1)];
+
+            if (prev && usb_event_same(prev, ev))
+                wb_count_inc(WB_CNT_USB_COALESCED);
+            else if (!fired)
+                fired = usb_evaluate(ev);
+            prev = ev;
         }
+
+        // Slots are only reused once the tail has moved past them
+        smp_store_release(&ring->tail, tail);
     }
-    return false;
 }
 
-// USB notifier callback
+static DECLARE_DELAYED_WORK(usb_batch_work, usb_batch_fn);
+
+/*
+ * Queue an event on this CPU's ring. The notifier chain runs in process
+ * context, so disabling preemption is enough to keep a single producer
+ * per ring.
+ */
+static bool usb_push(const struct usb_event *ev)
+{
+    struct usb_ring *ring = get_cpu_ptr(usb_rings);
+    unsigned int head = ring->head;
+    bool queued = false;
+
+    if (head - smp_load_acquire(&ring->tail) < USB_RING) {
+        ring->ev[head & (USB_RING - 1)] = *ev;
+        smp_store_release(&ring->head, head + 1);
+        queued = true;
+    }
+    put_cpu_ptr(usb_rings);
+
+    return queued;
+}
+
+/*
+ * USB notifier callback.
+ *
+ * Only records the event: the descriptors are reduced to a struct
+ * wb_usb_id while the device is still present, and matching and logging
+ * happen in the batch worker, so enumerating a hub full of devices is
+ * not slowed down by the trigger.
+ */
 static int usb_notifier_callback(struct notifier_block *self, unsigned long action, void *dev)
 {
+    const struct wb_usb_ruleset *rs;
     struct usb_device *udev;
-    u16 vid, pid;
-
-    bool matched;
+    struct usb_event ev;
+    unsigned int delay;
 
     /*
     * Only device notifications carry struct usb_device *.
@@ -129,16 +223,43 @@ static int usb_notifier_callback(struct notifier_block *self, unsigned long acti
     if (action != USB_DEVICE_ADD && action != USB_DEVICE_REMOVE)
         return NOTIFY_OK;
 
-    udev = dev;
-    vid = le16_to_cpu(udev->descriptor.idVendor);
-    pid = le16_to_cpu(udev->descriptor.idProduct);
-
-    matched = match_rules(vid, pid, action);
+    wb_count_inc(WB_CNT_USB_EVENTS);
 
-    if ((usb_whitelist && !matched) || (!usb_whitelist && matched)) {
-        wb_info("USB trigger fired (VID=0x%04x PID=0x%04x)\n", vid, pid);
-        wrong8007_activate();
+    udev = dev;
+    memset(&ev, 0, sizeof(ev));
+    ev.ts = ktime_get_ns();
+    ev.event = action == USB_DEVICE_ADD ? WB_USB_INSERT : WB_USB_EJECT;
+    ev.id.vid = le16_to_cpu(udev->descriptor.idVendor);
+    ev.id.pid = le16_to_cpu(udev->descriptor.idProduct);
+    ev.id.locked = READ_ONCE(host_locked);
+
+    rcu_read_lock();
+    rs = rcu_dereference(usb_rules);
+    if (!rs) {
+        rcu_read_unlock();
+        return NOTIFY_OK;
+    }
+    if (rs->need_classes)
+        usb_collect_classes(udev, ev.id.classes);
+    if (rs->need_strings) {
+        ev.id.serial = wb_usb_str_hash(udev->serial);
+        ev.id.mfr = wb_usb_str_hash(udev->manufacturer);
     }
+    if (rs->need_paths && udev->bus->busnum <= WB_USB_MAX_BUS &&
+        !wb_usb_parse_ports(udev->devpath, ev.id.ports, &ev.id.depth))
+        ev.id.bus = udev->bus->busnum;
+    rcu_read_unlock();
+
+    if (!usb_push(&ev)) {
+        // Never drop an event: match it here instead
+        wb_count_inc(WB_CNT_USB_RING_FULL);
+        usb_evaluate(&ev);
+        return NOTIFY_OK;
+    }
+
+    // A pending batch already covers this event; the window starts with the first one
+    delay = min_t(unsigned int, READ_ONCE(usb_debounce_ms), USB_DEBOUNCE_MAX_MS);
+    queue_delayed_work(system_highpri_wq, &usb_batch_work, msecs_to_jiffies(delay));
 
     return NOTIFY_OK;
 }
@@ -148,27 +269,113 @@ static struct notifier_block usb_nb = {
     .notifier_call = usb_notifier_callback,
 };
 
+/*
+ * Make a compiled rule set the active one, registering the notifier the
+ * first time rules are set.
+ */
+static void usb_publish(struct wb_usb_ruleset *rs)
+{
+    struct wb_usb_ruleset *old = rcu_dereference_protected(usb_rules, 1);
+
+    rcu_assign_pointer(usb_rules, rs);
+    if (old) {
+        synchronize_rcu();
+        wb_usb_ruleset_free(old);
+    }
+
+    if (!usb_registered) {
+        usb_register_notify(&usb_nb); // no return value on modern kernels
+        usb_registered = true;
+    }
+}
+
+/*
+ * Runtime rule update. An empty rule list would disarm the trigger, so
+ * it is refused once the module is running.
+ */
+static int usb_devices_apply(const char *val)
+{
+    struct wb_usb_ruleset *rs;
+
+    if (!usb_live)
+        return 0; // picked up by init
+
+    rs = wb_usb_rules_build(val);
+    if (IS_ERR(rs))
+        return PTR_ERR(rs);
+
+    if (!rs) {
+        wb_err("refusing to clear USB rules at runtime\n");
+        return -EINVAL;
+    }
+
+    usb_publish(rs);
+    wb_info("USB rules updated (%u rules)\n", rs->count);
+    return 0;
+}
+
 static int trigger_usb_init(void)
 {
-    int ret = parse_usb_devices();
-    if (ret)
-        return ret;
+    struct wb_usb_ruleset *rs;
+    int ret = 0;
+
+    kernel_param_lock(THIS_MODULE);
+
+    wb_usb_rules_init();
+
+    usb_rings = alloc_percpu(struct usb_ring);
+    if (!usb_rings) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    rs = wb_usb_rules_build(usb_devices ? usb_devices : "");
+    if (IS_ERR(rs)) {
+        ret = PTR_ERR(rs);
+        goto out;
+    }
 
-    if (usb_rule_count == 0) {
+    if (!rs) {
         wb_warn("USB trigger disabled (no USB rules)\n");
-        return 0; // success, but no hook
+        goto out; // success, but no hook
     }
 
-    usb_register_notify(&usb_nb); // no return value on modern kernels
-    wb_info("USB trigger initialized in %s mode (%d rules)\n",
-            usb_whitelist ? "whitelist" : "blacklist", usb_rule_count);
-    return 0;
+    usb_publish(rs);
+    wb_info("USB trigger initialized in %s mode (%u rules)\n",
+            usb_whitelist ? "whitelist" : "blacklist", rs->count);
+
+out:
+    if (ret) {
+        free_percpu(usb_rings);
+        usb_rings = NULL;
+    }
+    usb_live = !ret;
+    kernel_param_unlock(THIS_MODULE);
+    return ret;
 }
 
 static void trigger_usb_exit(void)
 {
-    if (usb_rule_count > 0)
+    struct wb_usb_ruleset *rs;
+
+    kernel_param_lock(THIS_MODULE);
+    usb_live = false;
+    kernel_param_unlock(THIS_MODULE);
+
+    if (usb_registered) {
         usb_unregister_notify(&usb_nb);
+        usb_registered = false;
+    }
+
+    // Events still waiting for their batch are dropped with the rules
+    cancel_delayed_work_sync(&usb_batch_work);
+    free_percpu(usb_rings);
+    usb_rings = NULL;
+
+    rs = rcu_dereference_protected(usb_rules, 1);
+    RCU_INIT_POINTER(usb_rules, NULL);
+    synchronize_rcu();
+    wb_usb_ruleset_free(rs);
     wb_info("USB trigger exited\n");
 }
 
@@ -0,0 +1,458 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrong8007: USB rule parsing and compilation
+ *
+ * Copyright (c) 2023, 03C0 (https://03c0.net/)
+ */
+
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/string.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/random.h>
+#include <linux/siphash.h>
+
+#include <wrong8007.h>
+#include <usb_rules.h>
+
+// Table of valid USB events and their masks
+static const struct {
+    const char *name;
+    u8 events;
+} evt_map[] = {
+    { "insert", WB_USB_INSERT },
+    { "eject",  WB_USB_EJECT },
+    { "any",    WB_USB_INSERT | WB_USB_EJECT },
+};
+
+// Per-load key for string hashes, so colliding strings cannot be precomputed
+static siphash_key_t str_key;
+
+void wb_usb_rules_init(void)
+{
+    get_random_bytes(&str_key, sizeof(str_key));
+}
+
+/*
+ * Hash a device string. 0 is reserved for "no string".
+ */
+u64 wb_usb_str_hash(const char *s)
+{
+    u64 h;
+
+    if (!s)
+        return 0;
+
+    h = siphash(s, strlen(s), &str_key);
+    return h ?: 1;
+}
+
+static inline struct hlist_head *
+usb_bucket(const struct wb_usb_ruleset *rs, enum wb_usb_kind kind, u32 key)
+{
+    return &rs->buckets[(kind << rs->hash_bits) | hash_32(key, rs->hash_bits)];
+}
+
+static int parse_id(const char *tok, int *out)
+{
+    u16 v;
+
+    if (!strcmp(tok, "*")) {
+        *out = -1;
+        return 0;
+    }
+
+    if (kstrtou16(tok, 16, &v))
+        return -EINVAL;
+
+    *out = v;
+    return 0;
+}
+
+/*
+ * Parse a dotted port path ("3" or "3.1.2", as in udev->devpath) into
+ * port numbers. "0", the root hub's own path, has no ports.
+ */
+int wb_usb_parse_ports(const char *s, u8 *ports, u8 *depth)
+{
+    unsigned int n = 0, port = 0;
+    bool digits = false;
+
+    *depth = 0;
+    if (!strcmp(s, "0"))
+        return 0;
+
+    for (;; s++) {
+        if (*s >= '0' && *s <= '9') {
+            port = port * 10 + (*s - '0');
+            if (port > WB_USB_MAX_PORT)
+                return -EINVAL;
+            digits = true;
+            continue;
+        }
+
+        if ((*s != '.' && *s) || !digits || !port || n == WB_USB_MAX_DEPTH)
+            return -EINVAL;
+
+        ports[n++] = port;
+        if (!*s)
+            break;
+        port = 0;
+        digits = false;
+    }
+
+    *depth = n;
+    return 0;
+}
+
+// Parse "BUS-PORT[.PORT...]", the device's name in /sys/bus/usb/devices
+static int parse_path(struct wb_usb_id *path, char *val)
+{
+    char *ports = strchr(val, '-');
+
+    if (!ports)
+        return -EINVAL;
+    *ports++ = '\0';
+
+    if (kstrtou8(val, 10, &path->bus) || !path->bus || path->bus > WB_USB_MAX_BUS)
+        return -EINVAL;
+
+    if (wb_usb_parse_ports(ports, path->ports, &path->depth) || !path->depth)
+        return -EINVAL;
+
+    return 0;
+}
+
+/*
+ * Parse a single rule: colon-separated fields.
+ *
+ *   VID:PID        exact device (hex)
+ *   VID:*          any product of a vendor
+ *   insert|eject|any
+ *   class=CC       device or interface class (hex); on its own, any vendor
+ *   serial=S       iSerialNumber string
+ *   mfr=S          manufacturer string
+ *   locked         only while the host is marked locked
+ *   path=B-P.P     port path; with VID:PID, pins that device to the port
+ *
+ * The fields are split in place.
+ */
+static int parse_rule(struct wb_usb_rule *r, enum wb_usb_kind *kind,
+                      struct wb_usb_id *path, char *spec)
+{
+    int ids[2] = { -1, -1 };
+    unsigned int nids = 0;
+    char *field;
+    int j;
+
+    r->events = WB_USB_INSERT | WB_USB_EJECT;
+    r->class = -1;
+
+    while ((field = strsep(&spec, ":")) != NULL) {
+        char *val = strchr(field, '=');
+
+        if (val) {
+            *val++ = '\0';
+
+            if (!*val)
+                return -EINVAL;
+
+            if (!strcmp(field, "class")) {
+                u8 class;
+
+                if (kstrtou8(val, 16, &class))
+                    return -EINVAL;
+                r->class = class;
+            } else if (!strcmp(field, "serial")) {
+                r->serial = wb_usb_str_hash(val);
+            } else if (!strcmp(field, "mfr")) {
+                r->mfr = wb_usb_str_hash(val);
+            } else if (!strcmp(field, "path")) {
+                if (parse_path(path, val))
+                    return -EINVAL;
+            } else {
+                return -EINVAL;
+            }
+            continue;
+        }
+
+        if (!strcmp(field, "locked")) {
+            r->locked = true;
+            continue;
+        }
+
+        for (j = 0; j < ARRAY_SIZE(evt_map); j++) {
+            if (!strcmp(field, evt_map[j].name))
+                break;
+        }
+        if (j < ARRAY_SIZE(evt_map)) {
+            r->events = evt_map[j].events;
+            continue;
+        }
+
+        if (nids == ARRAY_SIZE(ids) || parse_id(field, &ids[nids]))
+            return -EINVAL;
+        nids++;
+    }
+
+    if (nids == 1)
+        return -EINVAL; // a VID needs a PID or '*'
+
+    if (path->bus) {
+        // A pinned device must be named exactly
+        if ((ids[0] >= 0) != (ids[1] >= 0))
+            return -EINVAL;
+        *kind = WB_USB_PATH;
+        r->pinned = ids[0] >= 0;
+        r->key = r->pinned ? (u32)ids[0] << 16 | ids[1] : 0;
+        return 0;
+    }
+
+    if (ids[0] >= 0 && ids[1] >= 0) {
+        *kind = WB_USB_DEVICE;
+        r->key = (u32)ids[0] << 16 | ids[1];
+    } else if (ids[0] >= 0) {
+        *kind = WB_USB_VENDOR;
+        r->key = ids[0];
+    } else if (ids[1] < 0 && r->class >= 0) {
+        *kind = WB_USB_CLASS;
+        r->key = r->class;
+    } else {
+        return -EINVAL; // would match every device
+    }
+
+    return 0;
+}
+
+/*
+ * Find or create the trie node a port path ends at.
+ */
+static struct wb_usb_port_node *path_node(struct wb_usb_ruleset *rs,
+                                          const struct wb_usb_id *path)
+{
+    struct wb_usb_port_node **slot = &rs->buses[path->bus];
+    unsigned int i;
+
+    for (i = 0;; i++) {
+        if (!*slot) {
+            *slot = kzalloc(sizeof(**slot), GFP_KERNEL);
+            if (!*slot)
+                return NULL;
+        }
+        if (i == path->depth)
+            return *slot;
+        slot = &(*slot)->child[path->ports[i] - 1];
+    }
+}
+
+static void port_node_free(struct wb_usb_port_node *node)
+{
+    unsigned int i;
+
+    if (!node)
+        return;
+
+    for (i = 0; i < WB_USB_MAX_PORT; i++)
+        port_node_free(node->child[i]);
+    kfree(node);
+}
+
+/*
+ * Parse and compile a comma-separated rule list in one pass.
+ *
+ * Returns NULL for an empty list and an ERR_PTR on invalid input.
+ */
+struct wb_usb_ruleset *wb_usb_rules_build(const char *spec)
+{
+    struct wb_usb_ruleset *rs;
+    unsigned int max = 1, n = 0, i;
+    char *buf, *cur, *entry;
+    const char *p;
+    int ret;
+
+    for (p = spec; *p; p++) {
+        if (*p == ',')
+            max++;
+    }
+
+    if (max > WB_USB_MAX_RULES) {
+        wb_err("too many USB rules (max %d)\n", WB_USB_MAX_RULES);
+        return ERR_PTR(-E2BIG);
+    }
+
+    rs = kzalloc(sizeof(*rs), GFP_KERNEL);
+    if (!rs)
+        return ERR_PTR(-ENOMEM);
+
+    rs->hash_bits = ilog2(roundup_pow_of_two(max(max, 16U)));
+    buf = kstrdup(spec, GFP_KERNEL);
+    rs->rules = kvcalloc(max, sizeof(*rs->rules), GFP_KERNEL);
+    rs->buckets = kvcalloc(WB_USB_KINDS << rs->hash_bits,
+                           sizeof(*rs->buckets), GFP_KERNEL);
+    if (!buf || !rs->rules || !rs->buckets) {
+        ret = -ENOMEM;
+        goto err;
+    }
+
+    cur = buf;
+    for (i = 0; (entry = strsep(&cur, ",")) != NULL; i++) {
+        struct wb_usb_rule *r = &rs->rules[n];
+        struct wb_usb_id path = { };
+        enum wb_usb_kind kind;
+
+        // Skip empty entries (unlikely but possible)
+        if (!*entry)
+            continue;
+
+        ret = parse_rule(r, &kind, &path, entry);
+        if (ret) {
+            wb_err("invalid USB rule #%u\n", i);
+            goto err;
+        }
+
+        if (kind == WB_USB_PATH) {
+            struct wb_usb_port_node *node = path_node(rs, &path);
+
+            if (!node) {
+                ret = -ENOMEM;
+                goto err;
+            }
+            hlist_add_head(&r->node, &node->rules);
+            rs->need_paths = true;
+        } else {
+            hlist_add_head(&r->node, usb_bucket(rs, kind, r->key));
+            rs->kinds |= BIT(kind);
+        }
+
+        if (kind == WB_USB_CLASS)
+            set_bit(r->class, rs->classes);
+        if (r->class >= 0)
+            rs->need_classes = true;
+        if (r->serial || r->mfr)
+            rs->need_strings = true;
+        n++;
+    }
+
+    kfree(buf);
+
+    if (!n) {
+        wb_usb_ruleset_free(rs);
+        return NULL;
+    }
+
+    rs->count = n;
+    return rs;
+
+err:
+    kfree(buf);
+    wb_usb_ruleset_free(rs);
+    return ERR_PTR(ret);
+}
+
+void wb_usb_ruleset_free(struct wb_usb_ruleset *rs)
+{
+    unsigned int i;
+
+    if (!rs)
+        return;
+
+    for (i = 0; i <= WB_USB_MAX_BUS; i++)
+        port_node_free(rs->buses[i]);
+    kvfree(rs->buckets);
+    kvfree(rs->rules);
+    kfree(rs);
+}
+
+static bool str_match(u64 want, u64 have)
+{
+    return !want || want == have;
+}
+
+// Class and string conditions of a rule
+static bool rule_conds(const struct wb_usb_rule *r, const struct wb_usb_id *id)
+{
+    return (r->class < 0 || test_bit(r->class, id->classes)) &&
+           str_match(r->serial, id->serial) && str_match(r->mfr, id->mfr);
+}
+
+static bool lookup(const struct wb_usb_ruleset *rs, enum wb_usb_kind kind,
+                   u32 key, const struct wb_usb_id *id, u8 event)
+{
+    const struct wb_usb_rule *r;
+
+    if (!(rs->kinds & BIT(kind)))
+        return false;
+
+    hlist_for_each_entry(r, usb_bucket(rs, kind, key), node) {
+        if (r->key == key && (r->events & event) &&
+            (!r->locked || id->locked) && rule_conds(r, id))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Match a device event against a rule set: one probe into each table
+ * that holds rules, and one per class the device shares with a
+ * class-keyed rule.
+ */
+bool wb_usb_rules_match(const struct wb_usb_ruleset *rs,
+                        const struct wb_usb_id *id, u8 event)
+{
+    DECLARE_BITMAP(hit, WB_USB_CLASSES);
+    unsigned int class;
+
+    if (lookup(rs, WB_USB_DEVICE, (u32)id->vid << 16 | id->pid, id, event) ||
+        lookup(rs, WB_USB_VENDOR, id->vid, id, event))
+        return true;
+
+    if (!(rs->kinds & BIT(WB_USB_CLASS)) ||
+        !bitmap_and(hit, id->classes, rs->classes, WB_USB_CLASSES))
+        return false;
+
+    for_each_set_bit(class, hit, WB_USB_CLASSES) {
+        if (lookup(rs, WB_USB_CLASS, class, id, event))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Match a device event against the port path rules: a walk of at most
+ * WB_USB_MAX_DEPTH trie nodes, however many rules or devices there are.
+ *
+ * A plain path rule fires when a device matching its conditions comes or
+ * goes at that port. A pinned rule fires when its device leaves the port
+ * or when anything else shows up there.
+ */
+bool wb_usb_paths_match(const struct wb_usb_ruleset *rs,
+                        const struct wb_usb_id *id, u8 event)
+{
+    const struct wb_usb_port_node *node;
+    const struct wb_usb_rule *r;
+    unsigned int i;
+
+    if (!rs->need_paths || !id->bus || id->bus > WB_USB_MAX_BUS)
+        return false;
+
+    node = rs->buses[id->bus];
+    for (i = 0; node && i < id->depth; i++)
+        node = node->child[id->ports[i] - 1];
+    if (!node)
+        return false;
+
+    hlist_for_each_entry(r, &node->rules, node) {
+        bool same;
+
+        if (!(r->events & event) || (r->locked && !id->locked))
+            continue;
+
+        same = rule_conds(r, id) &&
+               (!r->pinned || r->key == ((u32)id->vid << 16 | id->pid));
+
+        if (r->pinned ? same == (event == WB_USB_EJECT) : same)
+            return true;
+    }
+    return false;
+}